@@ -0,0 +1,356 @@
+#pragma once
+const char *global =
+	"#Configuration for mymake\n"
+	"#Lines beginning with # are comments.\n"
+	"#Any unknown left-hand sides can be used as variables.\n"
+	"\n"
+	"[]\n"
+	"\n"
+	"#Extensions for source-files, ie. files that should be compiled.\n"
+	"ext+=cpp\n"
+	"ext+=cc\n"
+	"ext+=cxx\n"
+	"ext+=c++\n"
+	"ext+=c\n"
+	"\n"
+	"#Build directory\n"
+	"buildDir=build/\n"
+	"\n"
+	"#Executable directory\n"
+	"execDir=bin/\n"
+	"\n"
+	"#Ignore files.\n"
+	"ignore=*.template.*\n"
+	"\n"
+	"#Include path\n"
+	"include+=./\n"
+	"\n"
+	"#Run output by default\n"
+	"execute=yes\n"
+	"\n"
+	"#Show compilation time?\n"
+	"#showTime=no\n"
+	"\n"
+	"#Precompiled header.\n"
+	"#pch=std.h\n"
+	"\n"
+	"#Append the file type to the name of the intermediate file? This is useful if\n"
+	"#a target contains both eg. foo.cpp and foo.cc that should both be compiled.\n"
+	"#appendExt=no\n"
+	"\n"
+	"#Pre-build steps.\n"
+	"#preBuild=\n"
+	"\n"
+	"#Files generated by the pre-build steps. It is assumed these files will not introduce\n"
+	"#any additional dependencies to the target.\n"
+	"#preBuildCreates=\n"
+	"\n"
+	"#Post-build steps.\n"
+	"#postBuild=\n"
+	"\n"
+	"#Defines.\n"
+	"#define+=DEBUG\n"
+	"\n"
+	"#Compile this target in parallell?\n"
+	"#parallel=yes\n"
+	"\n"
+	"#Use max this # of threads to compile this target.\n"
+	"#maxThreads=4\n"
+	"\n"
+	"#Adjust the number of threads between minThreads and maxThreads depending on system load?\n"
+	"#adaptiveThreads=no\n"
+	"#minThreads=1\n"
+	"\n"
+	"#Limit memory usage of processes (in MiB, auto or no).\n"
+	"#maxMemory=auto\n"
+	"\n"
+	"#Number of threads used to examine files (useful on network file systems).\n"
+	"#prefetchThreads=8\n"
+	"\n"
+	"#Free all memory before exiting (only useful when looking for memory leaks).\n"
+	"#freeMemory=no\n"
+	"\n"
+	"#Send compilations to these build workers (started by mm --worker <address>).\n"
+	"#workers+=localhost:4711\n"
+	"\n"
+	"#Share job slots with make using the jobserver protocol (pipe, fifo or no).\n"
+	"#jobserver=pipe\n"
+	"\n"
+	"#Define command line. Should not need to be changed.\n"
+	"defines=<defineCl*define>\n"
+	"\n"
+	"#Static library\n"
+	"[lib]\n"
+	"\n"
+	"#Compile all files into a lib.\n"
+	"input=*\n"
+	"\n"
+	"#Do not run.\n"
+	"execute=no\n"
+	"\n"
+	"#Link the output of this target into any dependent targets.\n"
+	"linkOutput=yes\n"
+	"\n"
+	"#Forward dependencies.\n"
+	"forwardDeps=yes\n"
+	"\n"
+	"#Shared library\n"
+	"[sharedlib]\n"
+	"\n"
+	"#Compile all files.\n"
+	"input=*\n"
+	"\n"
+	"#Do not run.\n"
+	"execute=no\n"
+	"\n"
+	"\n"
+	"[release]\n"
+	"#Output somewhere else.\n"
+	"buildDir=release/build/\n"
+	"execDir=release/bin/\n"
+	"\n"
+	"[unix]\n"
+	"\n"
+	"execExt=\n"
+	"intermediateExt=o\n"
+	"\n"
+	"includeCl=-iquote\n"
+	"libraryCl=-l\n"
+	"localLibraryCl=\n"
+	"defineCl=-D \n"
+	"\n"
+	"flags=<useStandard*standard> -pipe\n"
+	"warnings=-Wall -Wextra\n"
+	"\n"
+	"#standard=c++11\n"
+	"useStandard=-std=\n"
+	"\n"
+	"#Send absolute paths to the compiler (better with Emacs).\n"
+	"absolutePath=yes\n"
+	"\n"
+	"#Compile the precompiled header.\n"
+	"pchFile=<pch>.gch\n"
+	"usePch=-include <noExt|pchFile>\n"
+	"pchCompile=g++ <defines> <flags> <warnings> <file> -c <includes> -o <output>\n"
+	"pchCompileCombined=no\n"
+	"\n"
+	"#Compile a single file.\n"
+	"compile=*:g++ <defines> <flags> <warnings> <usePch*if|pch> <file> -c <includes> -o <output>\n"
+	"\n"
+	"#Support C as well. Note that we don't support PCH for C compilation.\n"
+	"cflags=-pipe\n"
+	"compile+=*.c:gcc <defines> <cflags> <warnings> <file> -c <includes> -o <output>\n"
+	"\n"
+	"#Link all files\n"
+	"link=g++ <files> <linkFlags> <libs> -o <output>\n"
+	"\n"
+	"[unix,!release]\n"
+	"flags+=-g\n"
+	"\n"
+	"[unix,release]\n"
+	"flags+=-O3\n"
+	"\n"
+	"[unix,reproducible]\n"
+	"absolutePath=no\n"
+	"flags+=-ffile-prefix-map=<projectRoot>=.\n"
+	"# Needed for asm files, at least on GCC.\n"
+	"flags+=-fdebug-prefix-map=<projectRoot>=.\n"
+	"\n"
+	"[unix,lib]\n"
+	"\n"
+	"execExt=a\n"
+	"\n"
+	"#Link, remove the library first so that removed files do not get duplicated.\n"
+	"link=rm -f -- <output>; ar rcs <output> <files>\n"
+	"\n"
+	"[unix,sharedlib]\n"
+	"execExt=so\n"
+	"linkFlags+=-shared\n"
+	"\n"
+	"[unix,sharedlib,!pic]\n"
+	"# We need PIC on unix.\n"
+	"flags+=-fPIC\n"
+	"\n"
+	"[pic,unix]\n"
+	"# We need PIC on unix.\n"
+	"flags+=-fPIC\n"
+	"\n"
+	"#Sample configuration for compiling Qt5 applications on Unix.\n"
+	"[unix,qt]\n"
+	"qtLibCl=-I/usr/include/qt5/Qt\n"
+	"qtLibFlag=-lQt5\n"
+	"flags+=-fPIC -I/usr/include/qt5/ <qtLibCl*qtLib>\n"
+	"linkFlags+=<qtLibFlag*qtLib>\n"
+	"\n"
+	"#Qt libraries.\n"
+	"qtLib+=Core\n"
+	"qtLib+=Gui\n"
+	"qtLib+=Widgets\n"
+	"\n"
+	"ext+=h\n"
+	"appendExt=yes\n"
+	"compile+=*.h:touch <output>.cpp && moc <file> -o <output>.cpp && g++ <defines> <flags> <warnings> <output>.cpp -c -o <output>\n"
+	"\n"
+	"[windows]\n"
+	"\n"
+	"execExt=exe\n"
+	"intermediateExt=obj\n"
+	"\n"
+	"includeCl=/I\n"
+	"libraryCl=\n"
+	"localLibraryCl=\n"
+	"defineCl=/D\n"
+	"\n"
+	"#standard=c++17\n"
+	"useStandard=/std:\n"
+	"\n"
+	"#/EHsc - exception handling, /FC - full paths in diagnostics\n"
+	"flags=/nologo /EHsc /FC\n"
+	"warnings=/W3\n"
+	"linkFlags=/MANIFEST /NXCOMPAT\n"
+	"manifestId=1\n"
+	"\n"
+	"pchFile=<noExt|pch>.pch\n"
+	"usePch=/Yu\n"
+	"namePch=/Fp<pchFile>\n"
+	"\n"
+	"pchCompile=1!cl <defines> <file> <includes> <flags> <warnings> /Yc<title|pch> <namePch*if|pch> /c /Fo<output>\n"
+	"pchCompileCombined=yes\n"
+	"\n"
+	"compile=*:1!cl <defines> <file> <includes> <flags> <warnings> <usePch*title|pch> <namePch*if|pch> /c /Fo<output>\n"
+	"link=link <linkFlags> <libs> <files> /nologo /OUT:<output>\n"
+	"link+=mt -nologo -manifest <output>.manifest -outputresource:<output>;#<manifestId>\n"
+	"\n"
+	"cflags=/nologo /EHsc /FC\n"
+	"compile+=*.c:1!cl <defines> <file> <includes> <cflags> <warnings> /c /Fo<output>\n"
+	"\n"
+	"[windows,64]\n"
+	"linkFlags+=/MACHINE:X64\n"
+	"\n"
+	"[windows,!release]\n"
+	"flags+=/MDd /DEBUG /Zi /Fd<path|buildDir>\n"
+	"linkFlags+=/DEBUG /INCREMENTAL:NO /PDB:<path|execDir><titleNoExt|output>.pdb\n"
+	"\n"
+	"[windows,release]\n"
+	"flags+=/MD /O2\n"
+	"\n"
+	"[windows,release,pdb]\n"
+	"flags+=/DEBUG /Zi\n"
+	"linkFlags+=/DEBUG /INCREMENTAL:NO /PDB:<path|execDir><titleNoExt|output>.pdb\n"
+	"\n"
+	"[windows,lib]\n"
+	"execExt=lib\n"
+	"link=lib <files> /nologo /OUT:<output>\n"
+	"\n"
+	"[windows,sharedlib]\n"
+	"execExt=dll\n"
+	"linkFlags+=/DLL\n"
+	"manifestId=2\n"
+	"\n"
+	"[windows,!winMain,!sharedlib,!lib]\n"
+	"#Windows applications have a special entry point...\n"
+	"linkFlags+=/SUBSYSTEM:CONSOLE\n"
+	"define+=_CONSOLE\n";
+const char *project =
+	"#Sample project file for mymake.\n"
+	"\n"
+	"#Global, project-specific things.\n"
+	"[project]\n"
+	"\n"
+	"#Start with this project.\n"
+	"#input=a\n"
+	"\n"
+	"#Compile targets in parallel?\n"
+	"#parallel=yes\n"
+	"\n"
+	"#Prefix the output when building in parallel?\n"
+	"#usePrefix=vc|gnu|no\n"
+	"\n"
+	"#Note any options needed to build each target.\n"
+	"[build]\n"
+	"\n"
+	"#Example:\n"
+	"#a+=option\n"
+	"\n"
+	"\n"
+	"#Depencies between projects that mymake can not figure out.\n"
+	"[deps]\n"
+	"\n"
+	"#Example:\n"
+	"#a+=b\n"
+	"\n"
+	"\n"
+	"#Global settings applied for all targets.\n"
+	"[]\n";
+const char *target =
+	"#Configuration for mymake\n"
+	"#Lines beginning with # are comments.\n"
+	"#Any unknown left-hand sides can be used as variables.\n"
+	"\n"
+	"[]\n"
+	"\n"
+	"#Extensions for source-files, ie. files that should be compiled.\n"
+	"#ext+=cpp\n"
+	"#ext+=cc\n"
+	"#ext+=cxx\n"
+	"#ext+=c++\n"
+	"#ext+=c\n"
+	"\n"
+	"#Build directory\n"
+	"buildDir=build/\n"
+	"\n"
+	"#Executable directory\n"
+	"execDir=bin/\n"
+	"\n"
+	"#Ignore files.\n"
+	"ignore=*.template.*\n"
+	"\n"
+	"#Input file(s). Use * for all files (recursively), excluding build directory and bin directory.\n"
+	"#input=Xxx.cpp\n"
+	"\n"
+	"#Output filename, defaults to first input file.\n"
+	"#output=\n"
+	"\n"
+	"#Include path\n"
+	"include+=./\n"
+	"\n"
+	"#Include system libraries.\n"
+	"#library+=m\n"
+	"\n"
+	"#Include local libraries (eg. in other projects). Usually done automatically.\n"
+	"#localLibrary+=mylib\n"
+	"\n"
+	"#Run output by default\n"
+	"execute=yes\n"
+	"\n"
+	"#Show compilation time?\n"
+	"#showTime=no\n"
+	"\n"
+	"#Precompiled header.\n"
+	"#pch=std.h\n"
+	"\n"
+	"#Append the file type to the name of the intermediate file? This is useful if\n"
+	"#a target contains both eg. foo.cpp and foo.cc that should both be compiled.\n"
+	"#appendExt=no\n"
+	"\n"
+	"#Pre-build steps.\n"
+	"#preBuild=\n"
+	"\n"
+	"#Files generated by the pre-build steps. It is assumed these files will not introduce\n"
+	"#any additional dependencies to the target.\n"
+	"#preBuildCreates=\n"
+	"\n"
+	"#Post-build steps.\n"
+	"#postBuild=\n"
+	"\n"
+	"#Defines.\n"
+	"#define+=DEBUG\n"
+	"\n"
+	"#Compile this target in parallell?\n"
+	"#parallel=yes\n"
+	"\n"
+	"#Define values\n"
+	"#define+=TEST\n"
+	"\n"
+	"#Standard\n"
+	"#standard=c++17\n";
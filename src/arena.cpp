@@ -0,0 +1,71 @@
+#include "std.h"
+#include "arena.h"
+#include <cstdlib>
+
+// Size of each block, unless a larger allocation is needed.
+static const size_t blockSize = 64 * 1024;
+
+// Alignment of all allocations.
+static const size_t alignment = 2 * sizeof(void *);
+
+// Free memory when arenas are destroyed?
+static bool freeMemory = false;
+
+void Arena::setTeardown(bool teardown) {
+	freeMemory = teardown;
+}
+
+bool Arena::teardown() {
+	return freeMemory;
+}
+
+// Round up to the alignment.
+static inline size_t align(size_t size) {
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+Arena::Arena() : current(null), at(null), end(null), dtors(null), allocated(0) {}
+
+Arena::~Arena() {
+	if (!freeMemory)
+		return;
+
+	for (Dtor *d = dtors; d; d = d->prev)
+		(*d->fn)(d->object);
+
+	while (current) {
+		Block *prev = current->prev;
+		free(current);
+		current = prev;
+	}
+}
+
+void *Arena::alloc(size_t size) {
+	size = align(size);
+	if (size_t(end - at) < size) {
+		size_t header = align(sizeof(Block));
+		size_t s = max(blockSize, header + size);
+		Block *b = (Block *)malloc(s);
+		if (!b)
+			throw std::bad_alloc();
+		b->prev = current;
+		b->size = s;
+		current = b;
+		allocated += s;
+
+		at = (char *)b + header;
+		end = (char *)b + s;
+	}
+
+	void *r = at;
+	at += size;
+	return r;
+}
+
+void Arena::atDestroy(void (*fn)(void *), void *object) {
+	Dtor *d = (Dtor *)alloc(sizeof(Dtor));
+	d->prev = dtors;
+	d->fn = fn;
+	d->object = object;
+	dtors = d;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <new>
+
+/**
+ * Bump allocator for objects that are created in large numbers and live as long as their owner.
+ *
+ * Memory is allocated from large blocks, and everything is freed at once when the arena is
+ * destroyed. Objects created by 'create' are destroyed at the same time, in reverse order of
+ * creation. This avoids the cost of allocating and freeing each object individually, and keeps
+ * objects that are used together close to each other in memory.
+ *
+ * Since all memory is reclaimed by the OS when the process exits anyway, arenas (and some other
+ * large structures) skip the teardown entirely unless 'setTeardown' is called.
+ *
+ * Note: Not thread-safe. Each arena is expected to be used by a single thread at a time.
+ */
+class Arena : NoCopy {
+public:
+	// Create.
+	Arena();
+
+	// Destroy all objects and free the memory.
+	~Arena();
+
+	// Allocate 'size' bytes, aligned for any fundamental type.
+	void *alloc(size_t size);
+
+	// Create an object in the arena.
+	template <class T>
+	T *create() {
+		T *r = new (alloc(sizeof(T))) T();
+		atDestroy(&destroy<T>, r);
+		return r;
+	}
+
+	template <class T, class A>
+	T *create(const A &a) {
+		T *r = new (alloc(sizeof(T))) T(a);
+		atDestroy(&destroy<T>, r);
+		return r;
+	}
+
+	// Copy an array of objects that do not need to be destroyed (e.g. numbers).
+	template <class T>
+	T *copy(const T *src, size_t count) {
+		if (count == 0)
+			return null;
+		T *r = (T *)alloc(sizeof(T) * count);
+		for (size_t i = 0; i < count; i++)
+			r[i] = src[i];
+		return r;
+	}
+
+	// Number of bytes allocated from the system.
+	inline size_t size() const { return allocated; }
+
+	// Free memory when arenas are destroyed? Otherwise, the memory is leaked in the assumption that
+	// the arena is destroyed when the process is about to exit. Defaults to false.
+	static void setTeardown(bool teardown);
+	static bool teardown();
+
+private:
+	// A block of memory. The data follows the header.
+	struct Block {
+		Block *prev;
+		size_t size;
+	};
+
+	// A destructor to call.
+	struct Dtor {
+		Dtor *prev;
+		void (*fn)(void *);
+		void *object;
+	};
+
+	// Current block.
+	Block *current;
+
+	// Free space in the current block.
+	char *at;
+	char *end;
+
+	// Destructors to call.
+	Dtor *dtors;
+
+	// Total size of all blocks.
+	size_t allocated;
+
+	// Register a destructor.
+	void atDestroy(void (*fn)(void *), void *object);
+
+	// Destroy an object of type T.
+	template <class T>
+	static void destroy(void *object) {
+		((T *)object)->~T();
+	}
+};
+
+
+/**
+ * A read-only view of an array stored elsewhere (e.g. in an arena).
+ */
+template <class T>
+class Span {
+public:
+	// Create an empty span.
+	Span() : data(null), count(0) {}
+
+	// Create a span of 'count' elements starting at 'data'.
+	Span(const T *data, nat count) : data(data), count(count) {}
+
+	// Size.
+	inline nat size() const { return count; }
+	inline bool empty() const { return count == 0; }
+
+	// Element access.
+	inline const T &operator [](nat i) const { return data[i]; }
+
+	// Iteration.
+	typedef const T *const_iterator;
+	inline const_iterator begin() const { return data; }
+	inline const_iterator end() const { return data + count; }
+
+private:
+	const T *data;
+	nat count;
+};
@@ -35,6 +35,14 @@ nat atomicRead(volatile nat &v) {
 
 #endif
 
+void *atomicCAS(void *volatile &v, void *compare, void *exchange) {
+	return InterlockedCompareExchangePointer(&v, exchange, compare);
+}
+
+void *atomicSwap(void *volatile &v, void *exchange) {
+	return InterlockedExchangePointer(&v, exchange);
+}
+
 #else
 
 nat atomicInc(volatile nat &v) {
@@ -52,4 +60,18 @@ nat atomicRead(volatile nat &v) {
 	return __sync_fetch_and_add(&v, 0);
 }
 
+void *atomicCAS(void *volatile &v, void *compare, void *exchange) {
+	return __sync_val_compare_and_swap(&v, compare, exchange);
+}
+
+void *atomicSwap(void *volatile &v, void *exchange) {
+	void *old = v;
+	while (true) {
+		void *prev = __sync_val_compare_and_swap(&v, old, exchange);
+		if (prev == old)
+			return old;
+		old = prev;
+	}
+}
+
 #endif
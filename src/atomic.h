@@ -12,3 +12,9 @@ void atomicWrite(volatile nat &v, nat write);
 
 // Atomic read.
 nat atomicRead(volatile nat &v);
+
+// Compare and swap. If 'v' is equal to 'compare', replace it with 'exchange'. Returns the old value.
+void *atomicCAS(void *volatile &v, void *compare, void *exchange);
+
+// Swap. Replace the value of 'v' with 'exchange', return the old value.
+void *atomicSwap(void *volatile &v, void *exchange);
@@ -0,0 +1,184 @@
+#include "std.h"
+#include "buildstats.h"
+#include "filecache.h"
+
+// Number of commands shown in the summary.
+static const nat showSlowest = 10;
+
+// Collect statistics?
+static bool collect = false;
+
+// Lock for the data below.
+static Lock statsLock;
+
+// Commands executed.
+static vector<BuildStats::Command> executed;
+
+// Total time spent waiting for a free slot.
+static Timespan blockedTime;
+
+// Counters.
+static nat64 counters[BuildStats::counterCount];
+
+void BuildStats::setEnabled(bool enabled) {
+	collect = enabled;
+}
+
+bool BuildStats::enabled() {
+	return collect;
+}
+
+void BuildStats::command(Kind kind, const String &name, int result, const ProcStats &stats) {
+	if (!collect)
+		return;
+
+	Lock::Guard z(statsLock);
+	executed << Command(kind, name, result, stats);
+}
+
+vector<BuildStats::Command> BuildStats::commands() {
+	Lock::Guard z(statsLock);
+	return executed;
+}
+
+void BuildStats::blocked(const Timespan &time) {
+	if (!collect)
+		return;
+
+	Lock::Guard z(statsLock);
+	blockedTime += time;
+}
+
+void BuildStats::count(Counter counter) {
+	if (!collect)
+		return;
+
+	Lock::Guard z(statsLock);
+	counters[counter]++;
+}
+
+// Format 'part' as a percentage of 'whole'.
+static String percent(nat64 part, nat64 whole) {
+	if (whole == 0)
+		return "-";
+	return toS(part * 100 / whole) + "%";
+}
+
+// Names of the kinds of commands.
+static const char *kindNames[] = { "compile", "link", "step" };
+
+// Write a string to a JSON file.
+static void jsonString(ostream &to, const String &str) {
+	to << '"';
+	for (nat i = 0; i < str.size(); i++) {
+		char c = str[i];
+		switch (c) {
+		case '"':
+			to << "\\\"";
+			break;
+		case '\\':
+			to << "\\\\";
+			break;
+		case '\n':
+			to << "\\n";
+			break;
+		case '\t':
+			to << "\\t";
+			break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				const char *hex = "0123456789abcdef";
+				to << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+			} else {
+				to << c;
+			}
+			break;
+		}
+	}
+	to << '"';
+}
+
+// Write the statistics as JSON. Times are in microseconds. Assumes 'statsLock' is held.
+static void writeJson(const Path &file, const Timespan &total, nat slots, const FileCache &files) {
+	ofstream to(toS(file).c_str());
+	if (!to) {
+		WARNING("Failed to write statistics to " << file);
+		return;
+	}
+
+	to << "{\n";
+	to << "\t\"wallTime\": " << total.micros() << ",\n";
+	to << "\t\"slots\": " << slots << ",\n";
+	to << "\t\"blockedTime\": " << blockedTime.micros() << ",\n";
+	to << "\t\"fileSystem\": { \"hits\": " << files.hits() << ", \"misses\": " << files.misses()
+	   << ", \"listings\": " << files.listings() << " },\n";
+	to << "\t\"includes\": { \"scanned\": " << counters[BuildStats::scanned]
+	   << ", \"cached\": " << counters[BuildStats::cachedIncludes] << " },\n";
+	to << "\t\"files\": { \"compiled\": " << counters[BuildStats::compiled]
+	   << ", \"upToDate\": " << counters[BuildStats::upToDate] << " },\n";
+
+	to << "\t\"commands\": [";
+	for (nat i = 0; i < executed.size(); i++) {
+		const BuildStats::Command &c = executed[i];
+		to << (i > 0 ? ",\n" : "\n") << "\t\t{ \"name\": ";
+		jsonString(to, c.name);
+		to << ", \"kind\": \"" << kindNames[c.kind] << "\""
+		   << ", \"result\": " << c.result
+		   << ", \"wallTime\": " << c.stats.wallTime.micros()
+		   << ", \"userTime\": " << c.stats.userTime.micros()
+		   << ", \"systemTime\": " << c.stats.systemTime.micros()
+		   << ", \"peakMemory\": " << c.stats.peakMemory
+		   << ", \"reads\": " << c.stats.reads
+		   << ", \"writes\": " << c.stats.writes << " }";
+	}
+	to << "\n\t]\n";
+	to << "}\n";
+}
+
+void BuildStats::report(const Path &json, const Timespan &total, nat slots, const FileCache &files) {
+	Lock::Guard z(statsLock);
+
+	std::stable_sort(executed.begin(), executed.end());
+
+	Timespan user, system, busy;
+	nat failed = 0;
+	for (nat i = 0; i < executed.size(); i++) {
+		const ProcStats &s = executed[i].stats;
+		user += s.userTime;
+		system += s.systemTime;
+		busy += s.wallTime;
+		if (executed[i].result != 0)
+			failed++;
+	}
+
+	nat64 available = nat64(max(total.micros(), int64(0))) * max(slots, nat(1));
+	nat64 hits = files.hits(), misses = files.misses(), listings = files.listings();
+
+	PLN("-- Build statistics --");
+	PLN("Total time: " << total << " with " << slots << " slots");
+	PLN("Commands: " << executed.size() << " executed, " << failed << " failed");
+	PLN("CPU time: " << (user + system) << " (user " << user << ", system " << system << ")");
+	PLN("CPU utilization: " << percent((user + system).micros(), available) << " of the available slots, "
+		<< "slots occupied " << percent(busy.micros(), available) << " of the time");
+	PLN("Waiting for a free slot: " << blockedTime << " (sum over all threads)");
+
+	if (!executed.empty()) {
+		PLN("Slowest commands:");
+		for (nat i = 0; i < min(executed.size(), showSlowest); i++) {
+			const Command &c = executed[i];
+			PLN("  " << c.stats.wallTime << ": " << c.name << " (CPU " << (c.stats.userTime + c.stats.systemTime)
+				<< ", " << (c.stats.peakMemory >> 20) << " MiB)");
+		}
+	}
+
+	PLN("File system: " << (hits + misses) << " queries, " << percent(hits, hits + misses) << " answered from the cache, "
+		<< (misses - listings) << " files examined, " << listings << " directories listed");
+	PLN("Include cache: " << counters[scanned] << " files scanned, " << counters[cachedIncludes] << " up to date in the cache");
+	PLN("Files: " << counters[compiled] << " compiled, " << counters[upToDate] << " up to date");
+
+	// Note: We don't create the build directory only to save the statistics.
+	if (json.parent().exists()) {
+		writeJson(json, total, slots, files);
+		PLN("Statistics written to " << json);
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "path.h"
+#include "process.h"
+
+class FileCache;
+
+/**
+ * Statistics about a build, collected when mymake is started with --stats: the resources used by
+ * each command, the time spent waiting for a free slot, and counters for the work done by mymake
+ * itself. Summarized at the end of the build, and written as JSON to the build directory.
+ *
+ * Nothing is collected unless 'setEnabled' is called.
+ *
+ * Thread safe.
+ */
+class BuildStats {
+public:
+	// Collect statistics?
+	static void setEnabled(bool enabled);
+	static bool enabled();
+
+	// Kind of command.
+	enum Kind {
+		// Compiling a file.
+		compiling,
+		// Linking a target.
+		linking,
+		// A pre- or post-build step.
+		step,
+	};
+
+	/**
+	 * A command that was executed.
+	 */
+	class Command {
+	public:
+		Command(Kind kind, const String &name, int result, const ProcStats &stats) :
+			kind(kind), name(name), result(result), stats(stats) {}
+
+		// Kind of command.
+		Kind kind;
+
+		// Name of the command (a file, relative to the project root).
+		String name;
+
+		// Result.
+		int result;
+
+		// Statistics.
+		ProcStats stats;
+
+		// Order by wall time, slowest first.
+		bool operator <(const Command &o) const {
+			return stats.wallTime > o.stats.wallTime;
+		}
+	};
+
+	// A command identified by 'name' terminated.
+	static void command(Kind kind, const String &name, int result, const ProcStats &stats);
+
+	// Get all commands that have terminated so far.
+	static vector<Command> commands();
+
+	// A thread waited 'time' for a free slot before it could start a process.
+	static void blocked(const Timespan &time);
+
+	// Counters for work done by mymake.
+	enum Counter {
+		// Files read to find includes.
+		scanned,
+		// Files whose includes were up to date in the include cache.
+		cachedIncludes,
+		// Files that were compiled.
+		compiled,
+		// Files that were up to date.
+		upToDate,
+
+		counterCount
+	};
+
+	// Increase a counter.
+	static void count(Counter counter);
+
+	// Print a summary, and write the full statistics to 'json' if its directory exists. 'total' is
+	// the duration of the build, 'slots' is the number of processes we were allowed to run at once.
+	static void report(const Path &json, const Timespan &total, nat slots, const FileCache &files);
+};
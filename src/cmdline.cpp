@@ -29,6 +29,9 @@ static const pair<String, char> rawLongOptions[] = {
 	make_pair("threads", 'j'),
 	make_pair("time", 't'),
 	make_pair("global-config", '\5'),
+	make_pair("worker", '\6'),
+	make_pair("stats", '\7'),
+	make_pair("history", '\10'),
 };
 static const map<String, char> longOptions(rawLongOptions, rawLongOptions + ARRAY_COUNT(rawLongOptions));
 
@@ -70,12 +73,19 @@ static const char *helpStr =
 	"--default-input - add this file as an input if no other is specified on command-line\n"
 	"                  or in configuration. Useful when integrating with text editors.\n"
 	"--time, -t      - output the time taken for various stages of mymake.\n"
+	"--stats         - output statistics about the build (slowest commands, CPU utilization, caches)\n"
+	"                - and write them to stats.json in the build directory.\n"
+	"--history       - show the history of previous builds, and files whose compile time has\n"
+	"                - regressed, instead of building.\n"
 	"--global-config - specify the location of the global configuration file. Used to override\n"
 #ifdef WINDOWS
 	"                - the default value of C:/Users/<user>/AppData/Local/mymake/mymake.conf\n"
 #else
 	"                - the default value of ~/.config/mymake/mymake.conf\n"
 #endif
+	"--worker        - run as a build worker, accepting commands from other instances of mymake\n"
+	"                - on the given address (unix:<path> or <host>:<port>). Uses -j or maxThreads\n"
+	"                - from the global configuration as the number of concurrent commands.\n"
 	"";
 
 CmdLine::CmdLine(const vector<String> &params) :
@@ -85,6 +95,8 @@ CmdLine::CmdLine(const vector<String> &params) :
 	showHelp(false),
 	clean(false),
 	times(false),
+	stats(false),
+	history(false),
 	globalConfig(defaultGlobalConfig()),
 	threads(0),
 	createGlobal(false) {
@@ -301,6 +313,15 @@ bool CmdLine::parseOption(char opt) {
 		case '\5':
 			state = sGlobalConfig;
 			break;
+		case '\6':
+			state = sWorker;
+			break;
+		case '\7':
+			stats = true;
+			break;
+		case '\10':
+			history = true;
+			break;
 		default:
 			return false;
 		}
@@ -392,6 +413,9 @@ bool CmdLine::optionParam(const String &v) {
 	case sGlobalConfig:
 		globalConfig = Path(v).makeAbsolute();
 		return true;
+	case sWorker:
+		worker = v;
+		return true;
 	case sSetCWD:
 		if (const char *error = Path::chdir(v)) {
 			PLN("Failed to change directory to " << v << ": " << error);
@@ -53,9 +53,18 @@ public:
 	// Show times.
 	bool times;
 
+	// Collect and show build statistics.
+	bool stats;
+
+	// Show the build history instead of building.
+	bool history;
+
 	// Location of the global configuration file.
 	Path globalConfig;
 
+	// Run as a build worker on this address, if not empty.
+	String worker;
+
 	// Apply to Config object.
 	void apply(const set<String> &usedOptions, Config &config) const;
 
@@ -76,6 +85,7 @@ private:
 		sCreateGlobal,
 		sGlobalConfig,
 		sSetCWD,
+		sWorker,
 	};
 
 	State state;
@@ -10,7 +10,7 @@ Commands::Commands() {}
 bool Commands::check(const String &file, const String &command) {
 	Lock::Guard z(lock);
 
-	hash_map<String, String>::const_iterator found = files.find(file);
+	FlatMap<String, String>::const_iterator found = files.find(file);
 
 	// We consider it "same" if we don't have it in our storage. If so, we add it to ourselves so
 	// that we may remember it in the future. It might be the case that this file will soon be
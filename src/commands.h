@@ -33,5 +33,5 @@ private:
 	mutable Lock lock;
 
 	// Storage of all command lines. Paths are relative.
-	hash_map<String, String> files;
+	FlatMap<String, String> files;
 };
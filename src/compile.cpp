@@ -28,10 +28,17 @@ namespace compile {
 	}
 
 
-	Target::Target(const Path &wd, const Config &config) :
+	Target::Target(const Path &wd, const Config &config, FileCache *fileCache, ExtCache *extCache) :
 		wd(wd),
 		config(config),
-		includes(wd, config),
+		fileCache(fileCache ? fileCache : new FileCache()),
+		ownFileCache(fileCache == null),
+		includes(wd, config, *this->fileCache),
+		found(*this->fileCache),
+		foundSignature(0),
+		foundChanged(false),
+		extCache(extCache),
+		ownExtCache(extCache == null),
 		compileVariants(config.getArray("compile")),
 		buildDir(wd + Path(config.getVars("buildDir"))),
 		intermediateExt(config.getVars("intermediateExt")),
@@ -54,7 +61,6 @@ namespace compile {
 			}
 		}
 
-		// Add file extensions. We don't bother with uniqueness here, and let the ExtCache deal with that.
 		validExts = config.getArray("ext");
 
 		vector<String> ign = config.getArray("ignore");
@@ -70,11 +76,33 @@ namespace compile {
 			includes.load(buildDir + "includes");
 			commands.load(buildDir + "commands");
 		}
+
+		// Note: Failures are still relevant after a forced rebuild.
+		failures.load(buildDir + "failed");
+
+		if (ownExtCache) {
+			this->extCache = new ExtCache(*this->fileCache);
+			if (!force)
+				this->extCache->load(buildDir + "extcache");
+		}
+
+		// Note: The memory usage is still relevant after a forced rebuild.
+		memory.load(buildDir + "memory");
+
+		if (!config.getArray("workers").empty()) {
+			remoteRoot = Path(config.getVars("projectRoot"));
+			remoteRoot.makeDir();
+		}
 	}
 
 	Target::~Target() {
 		// We do this in "save", since if we execute the binary, the destructor will not be executed.
 		// includes.save(buildDir + "includes");
+
+		if (ownExtCache)
+			delete extCache;
+		if (ownFileCache)
+			delete fileCache;
 	}
 
 	void Target::clean() {
@@ -87,11 +115,54 @@ namespace compile {
 		e.recursiveDelete();
 	}
 
+	nat64 Target::findSignature() const {
+		// FNV-1a of everything that affects the result of 'find' apart from the files themselves.
+		String data = toS(wd) + "\n" + toS(config);
+
+		nat64 hash = 0xcbf29ce484222325ULL;
+		for (nat i = 0; i < data.size(); i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
 	bool Target::find() {
+		foundSignature = findSignature();
+		if (!force && found.load(buildDir + "find", foundSignature)) {
+			DEBUG("Using previously found files for target in " << wd << " (checked " << found.watched() << " paths)", VERBOSE);
+
+			toCompile.clear();
+			for (nat i = 0; i < found.files.size(); i++) {
+				const FindCache::File &f = found.files[i];
+				toCompile << Compile(f.file, f.pch, f.autoFound);
+			}
+			dependsOn.insert(found.dependsOn.begin(), found.dependsOn.end());
+			output = found.output;
+			return true;
+		}
+
+		found.clear();
+		if (!findFiles()) {
+			found.clear();
+			return false;
+		}
+
+		for (nat i = 0; i < toCompile.size(); i++) {
+			const Compile &c = toCompile[i];
+			found.files << FindCache::File(c, c.isPch, c.autoFound);
+		}
+		found.dependsOn = dependsOn;
+		found.output = output;
+		foundChanged = true;
+		return true;
+	}
+
+	bool Target::findFiles() {
 		DEBUG("Finding dependencies for target in " << wd, VERBOSE);
 		toCompile.clear();
 
-		ExtCache cache(validExts);
+		ExtCache &cache = *extCache;
 
 		CompileQueue q;
 		String outputName = config.getVars("output");
@@ -109,6 +180,11 @@ namespace compile {
 		// Add initial files.
 		addFiles(q, cache, config.getArray("input"));
 
+		// Headers we have already handled, indexed by PathId. Most headers are included by many
+		// files, so this saves a lot of work.
+		vector<bool> handled;
+		vector<PathId> newHeaders;
+
 		// Process files...
 		while (q.any()) {
 			Compile now = q.pop();
@@ -129,7 +205,8 @@ namespace compile {
 			toCompile << now;
 
 			// Add all other files we need.
-			IncludeInfo info = includes.info(now);
+			found.watch(now);
+			const IncludeInfo &info = includes.info(now);
 
 			// Check so that any pch file is included first.
 			if (!info.ignored && !pchStr.empty() && pchStr != info.firstInclude) {
@@ -139,13 +216,29 @@ namespace compile {
 				return false;
 			}
 
-			for (IncludeInfo::PathSet::const_iterator i = info.includes.begin(); i != info.includes.end(); ++i) {
-				DEBUG(now << " depends on " << *i, VERBOSE);
-				addFile(q, cache, *i);
+			newHeaders.clear();
+			for (nat i = 0; i < info.includes.size(); i++) {
+				PathId id = info.includes[i];
+				DEBUG(now << " depends on " << PathTable::path(id), VERBOSE);
+
+				if (id >= handled.size())
+					handled.resize(PathTable::count(), false);
+				if (!handled[id]) {
+					handled[id] = true;
+					newHeaders << id;
+				}
+			}
+
+			// Visit new headers in a consistent order.
+			std::sort(newHeaders.begin(), newHeaders.end(), &PathTable::less);
+			for (nat i = 0; i < newHeaders.size(); i++) {
+				const Path &inc = PathTable::path(newHeaders[i]);
+				found.watch(inc);
+				addFile(q, cache, inc);
 
 				// Is this a reference to another sub-project?
-				if (!i->isChild(wd)) {
-					Path parentRel = i->makeRelative(wd.parent());
+				if (!inc.isChild(wd)) {
+					Path parentRel = inc.makeRelative(wd.parent());
 					if (parentRel.first() != "..") {
 						dependsOn << parentRel.first();
 					}
@@ -170,7 +263,8 @@ namespace compile {
 			outputName = wd.title();
 
 		Path execDir = wd + Path(config.getVars("execDir"));
-		execDir.createDir();
+		fileCache->createDir(execDir);
+		found.watch(execDir);
 
 		output = execDir + Path(outputName).titleNoExt();
 		output.makeExt(config.getStr("execExt"));
@@ -191,37 +285,124 @@ namespace compile {
 		return true;
 	}
 
-	// Save command line on exit.
+	// A file to compile, and the information used to decide when to compile it.
+	struct CompileOrder {
+		// Index in 'toCompile'.
+		nat index;
+
+		// Precompiled header? These are always compiled first.
+		bool pch;
+
+		// Did the file fail to compile last time?
+		bool failed;
+
+		// Last modification of the file or any of its includes.
+		Timestamp modified;
+
+		// Should this file be compiled before 'o'?
+		bool operator <(const CompileOrder &o) const {
+			if (pch != o.pch)
+				return pch;
+			if (failed != o.failed)
+				return failed;
+			return modified > o.modified;
+		}
+	};
+
+	// Save command line, memory usage and failures on exit.
 	class SaveOnExit : public ProcessCallback {
 	public:
-		SaveOnExit(Commands *to, const String &file, const String &command) : to(to), key(file), command(command) {}
+		SaveOnExit(Commands *to, MemoryHistory *memory, FailureHistory *failures, const String &file, const String &command,
+				BuildStats::Kind kind, const String &name) :
+			to(to), memory(memory), failures(failures), key(file), command(command), kind(kind), name(name) {}
 
-		// Save to.
+		// Save to. May be null.
 		Commands *to;
 
+		// Save memory usage to.
+		MemoryHistory *memory;
+
+		// Save failures to. May be null.
+		FailureHistory *failures;
+
 		// Source file used as key.
 		String key;
 
 		// Command line.
 		String command;
 
-		virtual void exited(int result) {
-			if (result == 0)
+		// Kind of command and name used in the build statistics.
+		BuildStats::Kind kind;
+		String name;
+
+		virtual void exited(int result, const ProcStats &stats) {
+			BuildStats::command(kind, name, result, stats);
+
+			// Note: Failures due to errors in the source are not interesting, but processes that are
+			// killed by signals likely did not reach their peak.
+			memory->record(key, stats.peakMemory, result >= 0);
+
+			if (result == 0 && to)
 				to->set(key, command);
+
+			if (failures)
+				failures->record(key, result);
 		}
 	};
 
+	String Target::statsName(const String &key) const {
+		if (!BuildStats::enabled())
+			return String();
+
+		// Relative to the project, so that files in different targets can be told apart.
+		Path root(config.getStr("projectRoot"));
+		return toS(Path(key).makeAbsolute(wd).makeRelative(root));
+	}
+
 	Process *Target::saveShellProcess(const String &file, const String &command, const Path &cwd, nat skip) {
 		Process *p = shellProcess(command, cwd, &config.env, skip);
-		p->callback = new SaveOnExit(&commands, file, command);
+		p->callback = new SaveOnExit(&commands, &memory, &failures, file, command, BuildStats::compiling, statsName(file));
+		p->expectedMemory = memory.predict(file);
 		return p;
 	}
 
+	Process *Target::measuredShellProcess(BuildStats::Kind kind, const String &key, const String &command, const Path &cwd, nat skip) {
+		Process *p = shellProcess(command, cwd, &config.env, skip);
+		p->callback = new SaveOnExit(null, &memory, null, key, command, kind, statsName(key));
+		p->expectedMemory = memory.predict(key);
+		return p;
+	}
+
+	RemoteJob *Target::remoteJob(const Compile &src, const Path &output, const String &command) {
+		if (remoteRoot.isEmpty() || !output.isChild(remoteRoot))
+			return null;
+
+		RemoteJob *job = new RemoteJob();
+		job->root = remoteRoot;
+		job->command = command;
+		job->cwd = wd;
+		job->outputs << output;
+
+		// Files outside of the root are assumed to be present on the worker.
+		job->inputs << Path(src);
+		const IncludeInfo &info = includes.info(src);
+		for (nat i = 0; i < info.includes.size(); i++) {
+			const Path &inc = PathTable::path(info.includes[i]);
+			if (inc.isChild(remoteRoot))
+				job->inputs << inc;
+		}
+		if (!pchHeader.empty())
+			job->inputs << pchFile;
+
+		return job;
+	}
+
 	bool Target::compile() {
 		nat threads = to<nat>(config.getStr("maxThreads", "1"));
 
 		// Force serial execution?
-		if (!config.getBool("parallel", true))
+		bool parallel = config.getBool("parallel", true);
+		if (!parallel)
 			threads = 1;
 
 		DEBUG("Using max " << threads << " threads.", VERBOSE);
@@ -242,47 +423,79 @@ namespace compile {
 		data["output"] = "";
 		data["pchFile"] = toS(pchFile.makeRelative(wd));
 
-		TimeCache timeCache;
 		Timestamp latestModified(0);
 		ostringstream intermediateFiles;
 
 		// Any source files compiled?
 		bool sourceCompiled = false;
 
-		for (nat i = 0; i < toCompile.size(); i++) {
-			const Compile &src = toCompile[i];
-			Path output = src.makeRelative(wd).makeAbsolute(buildDir);
+		// Files written by the compilation.
+		vector<Path> written;
 
-			if (appendExt) {
-				String t = output.titleNoExt() + "_" + output.ext() + "." + intermediateExt;
-				output.makeTitle(t);
-			} else {
-				output.makeExt(intermediateExt);
+		// Examine all files we will need at once. Included files are examined when the include
+		// cache is loaded.
+		{
+			vector<Path> examine;
+			for (nat i = 0; i < toCompile.size(); i++) {
+				examine << Path(toCompile[i]);
+				examine << intermediateFile(toCompile[i]);
 			}
+			fileCache->prefetch(examine);
+		}
+
+		// Find the files to compile, and when they were last modified. The intermediate files are
+		// linked in the original order, regardless of the order we compile them in.
+		vector<CompileOrder> order;
+		for (nat i = 0; i < toCompile.size(); i++) {
+			const Compile &src = toCompile[i];
+			Path output = intermediateFile(src);
 
 			// Note: This creates the build directory (and any subdirectories) as needed.
-			output.parent().createDir();
+			fileCache->createDir(output.parent());
 
 			String file = toS(src.makeRelative(wd));
-			String out = toS(output.makeRelative(wd));
 			if (i > 0)
 				intermediateFiles << ' ';
-			intermediateFiles << out;
+			intermediateFiles << toS(output.makeRelative(wd));
 
 			if (ignored(file))
 				continue;
 
-			Timestamp lastModified = includes.info(src).lastModified(timeCache);
+			CompileOrder o;
+			o.index = i;
+			o.pch = src.isPch;
+			o.failed = failures.failed(file);
+			o.modified = includes.info(src).lastModified(*fileCache);
+			order << o;
+
+			// Update 'last modified'. We always want to do this, even if we did not need to compile the file.
+			if (order.size() == 1)
+				latestModified = o.modified;
+			else
+				latestModified = max(latestModified, o.modified);
+		}
+
+		// Compile files that failed last time, and recently modified files first, so that errors
+		// in them are reported as early as possible.
+		if (config.getBool("prioritize", true))
+			std::stable_sort(order.begin(), order.end());
+
+		for (nat i = 0; i < order.size(); i++) {
+			const Compile &src = toCompile[order[i].index];
+			Path output = intermediateFile(src);
+			String file = toS(src.makeRelative(wd));
+			String out = toS(output.makeRelative(wd));
+			Timestamp lastModified = order[i].modified;
 
 			bool pchValid = true;
 			if (src.isPch) {
 				// Note: This implies that pchFile exists as well.
-				pchValid = pchFile.mTime() >= lastModified;
+				pchValid = fileCache->mTime(pchFile) >= lastModified;
 			}
 
 			bool skip = !force     // Never skip a file if the force flag is set.
 				&& pchValid        // If the pch is invalid, don't skip.
-				&& output.mTime() >= lastModified; // If the output exists and is new enough, we can skip.
+				&& fileCache->mTime(output) >= lastModified; // If the output exists and is new enough, we can skip.
 
 			if (!combinedPch && src.isPch) {
 				String cmd = config.getStr("pchCompile");
@@ -304,9 +517,10 @@ namespace compile {
 					}
 
 					// Wait for it to complete...
-					if (!group.wait()) {
+					bool ok = group.wait();
+					fileCache->invalidate(this->pchFile);
+					if (!ok)
 						return false;
-					}
 				}
 			}
 
@@ -329,12 +543,21 @@ namespace compile {
 
 			if (skip && commands.check(file, cmd)) {
 				DEBUG("Skipping " << file << "...", VERBOSE);
-				DEBUG("Source modified: " << lastModified << ", output modified " << output.mTime(), DEBUG);
+				BuildStats::count(BuildStats::upToDate);
+				DEBUG("Source modified: " << lastModified << ", output modified " << fileCache->mTime(output), DEBUG);
 			} else {
 				sourceCompiled = true;
 				DEBUG("Compiling " << file << "...", NORMAL);
+				BuildStats::count(BuildStats::compiled);
 				DEBUG(cmd, COMMAND);
-				if (!group.spawn(saveShellProcess(file, cmd, wd, skipLines)))
+				Process *p = saveShellProcess(file, cmd, wd, skipLines);
+				// Note: Commands on workers are executed in parallel with local ones.
+				if (parallel && !src.isPch)
+					p->remote = remoteJob(src, output, cmd);
+				written << output;
+				if (src.isPch)
+					written << pchFile;
+				if (!group.spawn(p))
 					return false;
 
 				// If it is a pch, wait for it to finish.
@@ -343,16 +566,13 @@ namespace compile {
 						return false;
 				}
 			}
-
-			// Update 'last modified'. We always want to do this, even if we did not need to compile the file.
-			if (i == 0)
-				latestModified = lastModified;
-			else
-				latestModified = max(latestModified, lastModified);
 		}
 
 		// Wait for compilation to terminate.
-		if (!group.wait())
+		bool ok = group.wait();
+		for (nat i = 0; i < written.size(); i++)
+			fileCache->invalidate(written[i]);
+		if (!ok)
 			return false;
 
 
@@ -361,15 +581,16 @@ namespace compile {
 			Path libPath(libs[i]);
 			if (!libPath.isAbsolute())
 				libPath = libPath.makeAbsolute(wd);
-			if (libPath.exists()) {
-				latestModified = max(latestModified, libPath.mTime());
+			FileInfo libInfo = fileCache->info(libPath);
+			if (libInfo.exists) {
+				latestModified = max(latestModified, libInfo.mTime);
 			} else {
 				WARNING("Local library " << libPath << " not found. Use 'library' for system libraries.");
 			}
 		}
 
 		// Link the output.
-		bool skipLink = !force && !sourceCompiled && output.mTime() >= latestModified;
+		bool skipLink = !force && !sourceCompiled && fileCache->mTime(output) >= latestModified;
 
 		String finalOutput = toS(output.makeRelative(wd));
 		data["files"] = intermediateFiles.str();
@@ -388,7 +609,7 @@ namespace compile {
 
 		if (skipLink && commands.check(finalOutput, allCmds.str())) {
 			DEBUG("Skipping linking.", VERBOSE);
-			DEBUG("Output modified " << output.mTime() << ", input modified " << latestModified, DEBUG);
+			DEBUG("Output modified " << fileCache->mTime(output) << ", input modified " << latestModified, DEBUG);
 			return true;
 		}
 
@@ -398,10 +619,16 @@ namespace compile {
 			const String &cmd = linkCmds[i];
 			DEBUG(cmd, COMMAND);
 
-			if (!group.spawn(shellProcess(cmd, wd, &config.env, linkSkip[i])))
+			String key = finalOutput;
+			if (i > 0)
+				key += "#" + toS(i);
+
+			if (!group.spawn(measuredShellProcess(BuildStats::linking, key, cmd, wd, linkSkip[i])))
 				return false;
 
-			if (!group.wait())
+			bool ok = group.wait();
+			fileCache->invalidate(output);
+			if (!ok)
 				return false;
 		}
 
@@ -418,6 +645,19 @@ namespace compile {
 		return true;
 	}
 
+	Path Target::intermediateFile(const Compile &src) const {
+		Path output = src.makeRelative(wd).makeAbsolute(buildDir);
+
+		if (appendExt) {
+			String t = output.titleNoExt() + "_" + output.ext() + "." + intermediateExt;
+			output.makeTitle(t);
+		} else {
+			output.makeExt(intermediateExt);
+		}
+
+		return output;
+	}
+
 	String Target::preparePath(const Path &file) {
 		if (absolutePath) {
 			return toS(file.makeAbsolute(wd));
@@ -426,6 +666,15 @@ namespace compile {
 		}
 	}
 
+	bool Target::ignoredDir(const Path &dir) const {
+		String rel = toS(dir.makeRelative(wd));
+		for (nat j = 0; j < ignore.size(); j++) {
+			if (ignore[j].matchesAllIn(rel))
+				return true;
+		}
+		return false;
+	}
+
 	bool Target::ignored(const String &file) {
 		for (nat j = 0; j < ignore.size(); j++) {
 			if (ignore[j].matches(file)) {
@@ -441,19 +690,24 @@ namespace compile {
 
 		if (!steps.empty()) {
 			// Make sure the build directory is created.
-			buildDir.createDir();
+			fileCache->createDir(buildDir);
 		}
 
 		for (nat i = 0; i < steps.size(); i++) {
 			String expanded = config.expandVars(steps[i], options);
 			nat skip = extractSkip(expanded);
 			DEBUG(expanded, COMMAND);
-			if (!group.spawn(shellProcess(expanded, wd, &config.env, skip))) {
+			if (!group.spawn(measuredShellProcess(BuildStats::step, key + "#" + toS(i), expanded, wd, skip))) {
 				PLN("Failed running " << key << ": " << expanded);
 				return false;
 			}
 
-			if (!group.wait()) {
+			bool ok = group.wait();
+
+			// We don't know what the step modified.
+			fileCache->invalidate();
+
+			if (!ok) {
 				PLN("Failed running " << key << ": " << expanded);
 				return false;
 			}
@@ -462,13 +716,21 @@ namespace compile {
 		return true;
 	}
 
-	void Target::save() const {
+	bool Target::save() const {
 		// Note: We only save output if the build directory was actually created. This means that in
 		// cases we did not do any compilation, we never create anything.
-		if (buildDir.exists()) {
-			includes.save(buildDir + "includes");
-			commands.save(buildDir + "commands");
-		}
+		if (!fileCache->exists(buildDir))
+			return false;
+
+		includes.save(buildDir + "includes");
+		commands.save(buildDir + "commands");
+		memory.save(buildDir + "memory");
+		failures.save(buildDir + "failed");
+		if (foundChanged)
+			found.save(buildDir + "find", foundSignature);
+		if (ownExtCache)
+			extCache->save(buildDir + "extcache");
+		return true;
 	}
 
 	int Target::execute(const vector<String> &params) const {
@@ -516,7 +778,9 @@ namespace compile {
 		// 		return true;
 		// }
 
-		const vector<String> &exts = cache.find(path);
+		// The result depends on the contents of the directory.
+		found.watch(path.parent());
+		vector<String> exts = cache.find(path, validExts);
 
 		vector<Path> result;
 		for (nat i = 0; i < exts.size(); i++) {
@@ -541,12 +805,34 @@ namespace compile {
 		}
 	}
 
+	class Target::IgnoreFilter : public WalkFilter {
+	public:
+		IgnoreFilter(const Target &target) : target(target) {}
+
+		const Target &target;
+
+		virtual bool enter(const Path &dir) const {
+			return !target.ignoredDir(dir);
+		}
+	};
+
 	void Target::addFilesRecursive(CompileQueue &to, const Path &at) {
-		vector<Path> children = at.children();
+		// List all directories using multiple threads first. The order of the files is determined
+		// by the traversal below.
+		if (at == wd) {
+			IgnoreFilter filter(*this);
+			fileCache->prefetchTree(at, &filter);
+		}
+
+		found.watch(at);
+		const vector<Path> &children = fileCache->children(at);
 		for (nat i = 0; i < children.size(); i++) {
 			if (children[i].isDir()) {
 				DEBUG("Found directory " << children[i], DEBUG);
-				addFilesRecursive(to, children[i]);
+				if (ignoredDir(children[i]))
+					DEBUG("Ignoring the directory " << children[i].makeRelative(wd), VERBOSE);
+				else
+					addFilesRecursive(to, children[i]);
 			} else {
 				DEBUG("Found file " << children[i], DEBUG);
 				if (std::find(validExts.begin(), validExts.end(), children[i].ext()) != validExts.end()) {
@@ -4,10 +4,15 @@
 #include "uniquequeue.h"
 #include "includes.h"
 #include "commands.h"
+#include "memhistory.h"
+#include "failhistory.h"
+#include "findcache.h"
 #include "extcache.h"
+#include "filecache.h"
 #include "wildcard.h"
 #include "process.h"
 #include "env.h"
+#include "buildstats.h"
 
 namespace compile {
 
@@ -16,8 +21,10 @@ namespace compile {
      */
 	class Target : NoCopy {
 	public:
-		// 'wd' is the directory with the .mymake file in it.
-		Target(const Path &wd, const Config &config);
+		// 'wd' is the directory with the .mymake file in it. 'fileCache' and 'extCache' are shared
+		// with other targets. If they are null, the target uses its own caches, and stores the
+		// contents of 'extCache' in the build directory.
+		Target(const Path &wd, const Config &config, FileCache *fileCache = null, ExtCache *extCache = null);
 
 		// Saves some caches.
 		~Target();
@@ -31,12 +38,16 @@ namespace compile {
 		// Compile a directory with a .mymake file in.
 		bool compile();
 
-		// Save build files (include cache, etc.)
-		void save() const;
+		// Save build files (include cache, etc.) Returns false if nothing was saved since the build
+		// directory does not exist.
+		bool save() const;
 
 		// Execute the final executable.
 		int execute(const vector<String> &params) const;
 
+		// Metadata of files used by this target.
+		inline const FileCache &files() const { return *fileCache; }
+
 		// Depends on these projects:
 		set<String> dependsOn;
 
@@ -68,15 +79,48 @@ namespace compile {
 		// Configuration.
 		Config config;
 
+		// Metadata of files.
+		FileCache *fileCache;
+
+		// Do we own 'fileCache'?
+		bool ownFileCache;
+
 		// Include cache.
 		Includes includes;
 
 		// Previous command lines.
 		Commands commands;
 
+		// Memory usage of previous commands.
+		MemoryHistory memory;
+
+		// Files that failed to compile last time.
+		FailureHistory failures;
+
+		// Result of 'find', and the files it depends on.
+		FindCache found;
+
+		// Signature of the configuration used when computing 'found'.
+		nat64 foundSignature;
+
+		// Was 'found' computed during this run (i.e. does it need to be saved)?
+		bool foundChanged;
+
+		// Compute the signature of the configuration that affects 'find'.
+		nat64 findSignature() const;
+
+		// Find all files, without using 'found'.
+		bool findFiles();
+
 		// Valid extensions to compile.
 		vector<String> validExts;
 
+		// Cache of the files in each directory.
+		ExtCache *extCache;
+
+		// Do we own 'extCache'?
+		bool ownExtCache;
+
 		// Compilation command lines.
 		vector<String> compileVariants;
 
@@ -124,9 +168,25 @@ namespace compile {
 		// Files to compile in some valid order.
 		vector<Compile> toCompile;
 
+		// Get the intermediate file 'src' is compiled into.
+		Path intermediateFile(const Compile &src) const;
+
 		// Create a shellProcess instance that saves the output to 'commands' whenever the command succeeds.
 		Process *saveShellProcess(const String &file, const String &command, const Path &cwd, nat skip);
 
+		// Create a shellProcess instance that only records its memory usage in 'memory', using 'key'.
+		// 'kind' is used in the build statistics.
+		Process *measuredShellProcess(BuildStats::Kind kind, const String &key, const String &command, const Path &cwd, nat skip);
+
+		// Name of the command identified by 'key' in the build statistics.
+		String statsName(const String &key) const;
+
+		// Root directory for commands executed on build workers. Empty if no workers are used.
+		Path remoteRoot;
+
+		// Describe how to compile 'src' into 'output' on a build worker. Returns null if not possible.
+		RemoteJob *remoteJob(const Compile &src, const Path &output, const String &command);
+
 		// Run steps.
 		bool runSteps(const String &key, ProcGroup &group, const map<String, String> &options);
 
@@ -155,6 +215,12 @@ namespace compile {
 		// File ignored?
 		bool ignored(const String &file);
 
+		// Are all files in the directory 'dir' ignored?
+		bool ignoredDir(const Path &dir) const;
+
+		// Filter for 'FileCache::prefetchTree' that skips ignored directories.
+		class IgnoreFilter;
+
 	};
 
 }
@@ -54,6 +54,15 @@ bool Env::get(const String &key, String &out) const {
 	return true;
 }
 
+void Env::set(const String &key, const String &value) {
+	alter(key, value, replace);
+
+	// Re-create the OS representation when needed.
+	if (osData)
+		freeEnv(osData);
+	osData = null;
+}
+
 EnvData Env::data() const {
 	if (!osData)
 		osData = toData();
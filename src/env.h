@@ -35,6 +35,9 @@ public:
 	// Get a particular environment variable.
 	bool get(const String &key, String &out) const;
 
+	// Set a particular environment variable.
+	void set(const String &key, const String &value);
+
 private:
 	// Create an empty env-block.
 	Env();
@@ -1,36 +1,159 @@
 #include "std.h"
 #include "extcache.h"
 
-ExtCache::ExtCache(const vector<String> &exts) : validExts(exts.begin(), exts.end()) {}
+ExtCache::ExtCache(FileCache &files) : files(files), changed(false) {}
 
-const vector<String> &ExtCache::find(Path path) {
-	Path parent = path.parent();
-	if (explored.count(parent) == 0)
-		explorePath(parent);
+void ExtCache::Dir::add(Path file) {
+	// Note: Files like '.mymake' have an empty title, and are never interesting.
+	String ext = file.ext();
+	if (ext.empty() || file.titleNoExt().empty())
+		return;
+
+	file.makeExt("");
+	exts[file].push_back(ext);
+}
 
+vector<String> ExtCache::find(Path path, const vector<String> &valid) {
+	Path parent = path.parent();
 	path.makeExt("");
-	ExtMap::const_iterator i = exts.find(path);
-	if (i == exts.end())
-		return empty;
-	else
-		return i->second;
+
+	// Note: The lock is not held while examining the file system, so that other threads are not
+	// blocked by slow file systems. Two threads may therefore list the same directory, which is
+	// harmless.
+	Timestamp known;
+	bool checked, empty;
+	{
+		Lock::Guard z(lock);
+		const Dir &dir = dirs[parent];
+		checked = dir.checked;
+		known = dir.time;
+		empty = dir.exts.empty();
+		if (checked)
+			return matching(dir, path, valid);
+	}
+
+	Timestamp time = files.mTime(parent);
+	Dir listed;
+	bool explored = time != known || empty;
+	if (explored)
+		explorePath(parent, listed);
+
+	Lock::Guard z(lock);
+	Dir &dir = dirs[parent];
+	if (!dir.checked) {
+		dir.checked = true;
+		if (explored) {
+			changed = true;
+			dir.time = time;
+			dir.exts = listed.exts;
+		}
+	}
+
+	return matching(dir, path, valid);
+}
+
+vector<String> ExtCache::matching(const Dir &dir, const Path &path, const vector<String> &valid) {
+	vector<String> result;
+
+	Dir::ExtMap::const_iterator i = dir.exts.find(path);
+	if (i == dir.exts.end())
+		return result;
+
+	const vector<String> &exts = i->second;
+	for (nat e = 0; e < exts.size(); e++) {
+		for (nat v = 0; v < valid.size(); v++) {
+			if (Path::equal(exts[e], valid[v])) {
+				result << exts[e];
+				break;
+			}
+		}
+	}
+
+	return result;
 }
 
-void ExtCache::explorePath(const Path &path) {
-	explored.insert(path);
+void ExtCache::explorePath(const Path &path, Dir &into) {
+	DEBUG("Listing files in " << path, DEBUG);
 
-	vector<Path> children = path.children();
+	const vector<Path> &children = files.children(path);
 	for (nat i = 0; i < children.size(); i++) {
-		Path &p = children[i];
+		if (!children[i].isDir())
+			into.add(children[i]);
+	}
+}
+
+void ExtCache::load(const Path &from) {
+	Lock::Guard z(lock);
+
+	ifstream src(toS(from).c_str());
+	String line;
+	Dir *current = null;
+	Path currentPath;
 
-		if (p.isDir())
+	while (getline(src, line)) {
+		if (line.empty())
 			continue;
 
-		String ext = p.ext();
-		if (validExts.count(ext) == 0)
+		char type = line[0];
+		String rest = line.substr(1);
+
+		switch (type) {
+		case 'd': {
+			current = null;
+
+			nat space = rest.find(' ');
+			if (space == String::npos)
+				continue;
+
+			currentPath = Path(rest.substr(space + 1));
+			current = &dirs[currentPath];
+			current->time = Timestamp(to<nat64>(rest.substr(0, space)));
+			break;
+		}
+		case 'f':
+			if (current)
+				current->add(currentPath + rest);
+			break;
+		}
+	}
+}
+
+void ExtCache::save(const Path &to) const {
+	Lock::Guard z(lock);
+
+	if (!changed)
+		return;
+
+	ofstream dest(toS(to).c_str());
+
+	// Keep ordering stable in the file.
+	vector<Path> order;
+	order.reserve(dirs.size());
+	for (DirMap::const_iterator i = dirs.begin(); i != dirs.end(); ++i) {
+		const Dir &dir = i->second;
+
+		// Directories that do not exist, or that might be modified again without changing their
+		// modification time, are not interesting.
+		if (dir.exts.empty() || started - dir.time < Timespan::ms(2000))
 			continue;
 
-		p.makeExt("");
-		exts[p].push_back(ext);
+		order << i->first;
+	}
+	std::sort(order.begin(), order.end());
+
+	for (nat i = 0; i < order.size(); i++) {
+		const Dir &dir = dirs.find(order[i])->second;
+		dest << "d" << dir.time.time << ' ' << order[i] << endl;
+
+		vector<String> names;
+		for (Dir::ExtMap::const_iterator f = dir.exts.begin(); f != dir.exts.end(); ++f) {
+			String title = f->first.title();
+			for (nat e = 0; e < f->second.size(); e++)
+				names << (title + "." + f->second[e]);
+		}
+		std::sort(names.begin(), names.end());
+
+		for (nat e = 0; e < names.size(); e++)
+			dest << "f" << names[e] << endl;
 	}
 }
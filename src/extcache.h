@@ -1,6 +1,8 @@
 #pragma once
 #include "path.h"
 #include "hash.h"
+#include "sync.h"
+#include "filecache.h"
 
 /**
  * Cache for file extensions.
@@ -11,35 +13,69 @@
  * The approach taken here is to list files in a directory and preemptively find the answers to all
  * possible (valid) queries ahead of time, rather than looking for the answer by trying all
  * combinations each time.
+ *
+ * The cache is shared between all targets in a project, so it records all files with an extension
+ * regardless of which extensions are interesting, and each query specifies the extensions of
+ * interest. The listings are saved to disk together with the modification time of each directory,
+ * so that the next run only needs to check the modification time of a directory before using its
+ * listing. Each directory is checked at most once during each run.
+ *
+ * Note: Since targets in a project are examined in parallel, this class is thread-safe.
  */
-class ExtCache {
+class ExtCache : NoCopy {
 public:
-	// Create. Specify which extensions are interesting.
-	ExtCache(const vector<String> &exts);
+	// Create. Uses 'files' to examine directories.
+	ExtCache(FileCache &files);
+
+	// Get extensions among 'exts' for which a file named 'path' (ignoring its extension) exists.
+	vector<String> find(Path path, const vector<String> &exts);
 
-	// Get valid extensions for a file.
-	const vector<String> &find(Path path);
+	// Load listings from a previous run.
+	void load(const Path &from);
+
+	// Save listings, if anything was changed since they were loaded.
+	void save(const Path &to) const;
 
 private:
-	struct PathCompare {
-		bool operator() (const String &a, const String &b) const {
-			return Path::compare(a, b) < 0;
-		}
+	// Information about a directory.
+	class Dir {
+	public:
+		Dir() : time(0), checked(false) {}
+
+		// Modification time of the directory when it was listed.
+		Timestamp time;
+
+		// Checked during this run?
+		bool checked;
+
+		// Map of paths (without extension) to the available extensions.
+		typedef FlatMap<Path, vector<String>> ExtMap;
+		ExtMap exts;
+
+		// Add a file.
+		void add(Path file);
 	};
 
-	// Valid extensions.
-	set<String, PathCompare> validExts;
+	// File system.
+	FileCache &files;
+
+	// Lock for 'dirs' and 'changed'.
+	mutable Lock lock;
+
+	// All directories we know of.
+	typedef FlatMap<Path, Dir> DirMap;
+	DirMap dirs;
 
-	// Set of the paths we have explored.
-	hash_set<Path> explored;
+	// Any listings changed since 'load'?
+	bool changed;
 
-	// Map of paths (file titles) to the available extensions.
-	typedef hash_map<Path, vector<String>> ExtMap;
-	ExtMap exts;
+	// Time when this run started. Listings of directories modified close to this time are not
+	// saved, since the modification time has a limited resolution.
+	Timestamp started;
 
-	// Empty vector that we return in case of a cache miss.
-	vector<String> empty;
+	// List a directory. Does not need the lock.
+	void explorePath(const Path &path, Dir &into);
 
-	// Explore a path.
-	void explorePath(const Path &path);
+	// Find the extensions among 'valid' of 'path' (without extension) in 'dir'.
+	static vector<String> matching(const Dir &dir, const Path &path, const vector<String> &valid);
 };
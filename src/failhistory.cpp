@@ -0,0 +1,48 @@
+#include "std.h"
+#include "failhistory.h"
+#include "sync.h"
+
+FailureHistory::FailureHistory() {}
+
+bool FailureHistory::failed(const String &key) const {
+	Lock::Guard z(lock);
+	return files.count(key) > 0;
+}
+
+void FailureHistory::record(const String &key, int result) {
+	if (result < 0)
+		return;
+
+	Lock::Guard z(lock);
+	if (result == 0)
+		files.erase(key);
+	else
+		files.insert(key);
+}
+
+void FailureHistory::load(const Path &file) {
+	Lock::Guard z(lock);
+
+	ifstream src(toS(file).c_str());
+
+	String line;
+	while (getline(src, line)) {
+		if (!line.empty())
+			files.insert(line);
+	}
+}
+
+void FailureHistory::save(const Path &file) const {
+	Lock::Guard z(lock);
+
+	// Remove the file if nothing failed, so that old failures are not loaded again.
+	if (files.empty()) {
+		if (file.exists())
+			file.deleteFile();
+		return;
+	}
+
+	ofstream dst(toS(file).c_str());
+	for (set<String>::const_iterator i = files.begin(); i != files.end(); ++i)
+		dst << *i << '\n';
+}
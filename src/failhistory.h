@@ -0,0 +1,34 @@
+#pragma once
+#include "path.h"
+
+/**
+ * Source files whose compilation failed the last time they were compiled. These are compiled
+ * before other files, so that errors in them are reported as early as possible.
+ *
+ * Note: Since this class is used in callbacks, it is thread-safe.
+ */
+class FailureHistory {
+public:
+	// Create.
+	FailureHistory();
+
+	// Load data.
+	void load(const Path &file);
+
+	// Save data.
+	void save(const Path &file) const;
+
+	// Did the last compilation of 'key' fail?
+	bool failed(const String &key) const;
+
+	// Record the result of compiling 'key'. Processes killed by signals (negative results) are
+	// ignored, since they were likely killed by us.
+	void record(const String &key, int result);
+
+private:
+	// Lock for 'files'.
+	mutable Lock lock;
+
+	// Files that failed.
+	set<String> files;
+};
@@ -0,0 +1,293 @@
+#include "std.h"
+#include "filecache.h"
+#include "threadpool.h"
+#include "atomic.h"
+
+// Number of threads used when prefetching.
+static nat prefetchThreads = 8;
+
+// Minimum number of paths examined by each thread when prefetching. Starting a thread is more
+// expensive than examining a few files on a local file system.
+static const nat prefetchPerThread = 64;
+
+void FileCache::setPrefetchThreads(nat threads) {
+	prefetchThreads = max(threads, nat(1));
+}
+
+FileCache::FileCache() : hitCount(0), missCount(0), listCount(0) {}
+
+FileCache::~FileCache() {
+	invalidate();
+	for (nat i = 0; i < retired.size(); i++)
+		delete retired[i];
+}
+
+FileCache::Known &FileCache::known(PathId id) {
+	if (id >= files.size())
+		files.resize(id + 1);
+	return files[id];
+}
+
+FileInfo FileCache::info(const Path &path) {
+	PathId id = PathTable::id(path);
+	{
+		Lock::Guard z(lock);
+		const Known &k = known(id);
+		if (k.valid) {
+			hitCount++;
+			return k.info;
+		}
+		missCount++;
+	}
+
+	// Note: We don't hold the lock while examining the file, so that other threads may proceed.
+	FileInfo result = path.info();
+
+	Lock::Guard z(lock);
+	Known &k = known(id);
+	if (!k.valid) {
+		k.info = result;
+		k.valid = true;
+	}
+	return k.info;
+}
+
+/**
+ * Paths examined by prefetch. Each thread takes the next path to examine from 'next'.
+ */
+class Prefetch : NoCopy {
+public:
+	Prefetch(const vector<PathId> &paths) : paths(paths), result(paths.size(), FileInfo(false)), next(0) {}
+
+	// Paths to examine.
+	const vector<PathId> &paths;
+
+	// Result.
+	vector<FileInfo> result;
+
+	// Next path to examine.
+	volatile nat next;
+
+	// Examine paths until there are no more.
+	void main() {
+		nat i;
+		while ((i = atomicInc(next)) < paths.size())
+			result[i] = PathTable::path(paths[i]).info();
+	}
+};
+
+void FileCache::prefetch(const vector<Path> &paths) {
+	vector<PathId> ids;
+	ids.reserve(paths.size());
+	for (nat i = 0; i < paths.size(); i++)
+		ids << PathTable::id(paths[i]);
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	vector<PathId> unknown;
+	{
+		Lock::Guard z(lock);
+		for (nat i = 0; i < ids.size(); i++) {
+			if (!known(ids[i]).valid)
+				unknown << ids[i];
+		}
+	}
+
+	if (unknown.empty())
+		return;
+
+	Prefetch state(unknown);
+	nat threads = min(prefetchThreads, nat(unknown.size() / prefetchPerThread));
+	if (threads > 1) {
+		DEBUG("Examining " << unknown.size() << " files using " << threads << " threads.", DEBUG);
+
+		// Note: This thread is also used.
+		TaskGroup tasks;
+		for (nat i = 0; i < threads - 1; i++)
+			tasks.spawn(&Prefetch::main, state);
+		state.main();
+		tasks.wait();
+	} else {
+		state.main();
+	}
+
+	Lock::Guard z(lock);
+	missCount += unknown.size();
+	for (nat i = 0; i < unknown.size(); i++) {
+		Known &k = known(unknown[i]);
+		if (!k.valid) {
+			k.info = state.result[i];
+			k.valid = true;
+		}
+	}
+}
+
+/**
+ * State for prefetchTree. Threads take directories from 'pending' and add any subdirectories they
+ * find there. Each directory in 'pending' corresponds to one 'up' of 'available'. When no
+ * directories are pending or being listed, 'available' is raised once for each thread so that all
+ * of them exit.
+ */
+class TreeWalk : NoCopy {
+public:
+	TreeWalk(FileCache &cache, const WalkFilter *filter, nat threads) :
+		cache(cache), filter(filter), threads(threads), outstanding(0) {}
+
+	// Cache to fill.
+	FileCache &cache;
+
+	// Filter.
+	const WalkFilter *filter;
+
+	// Number of threads.
+	nat threads;
+
+	// Lock for 'pending' and 'outstanding'.
+	Lock lock;
+
+	// Directories to list.
+	vector<Path> pending;
+
+	// Number of directories that are pending or being listed.
+	nat outstanding;
+
+	// Available directories.
+	Sema available;
+
+	// Add a directory.
+	void push(const Path &dir) {
+		{
+			Lock::Guard z(lock);
+			pending << dir;
+			outstanding++;
+		}
+		available.up();
+	}
+
+	// Thread main function.
+	void main() {
+		while (true) {
+			available.down();
+
+			Path dir;
+			{
+				Lock::Guard z(lock);
+				if (pending.empty())
+					return;
+				dir = pending.back();
+				pending.pop_back();
+			}
+
+			cache.info(dir);
+			const vector<Path> &children = cache.children(dir);
+			for (nat i = 0; i < children.size(); i++) {
+				if (children[i].isDir() && (!filter || filter->enter(children[i])))
+					push(children[i]);
+			}
+
+			Lock::Guard z(lock);
+			if (--outstanding == 0) {
+				for (nat i = 0; i < threads; i++)
+					available.up();
+			}
+		}
+	}
+};
+
+void FileCache::prefetchTree(const Path &root, const WalkFilter *filter) {
+	// Without threads, this would just do the same work as the caller, in a different order.
+	nat threads = prefetchThreads;
+	if (threads <= 1)
+		return;
+
+	TreeWalk walk(*this, filter, threads);
+	walk.push(root);
+
+	// Note: This thread is also used.
+	TaskGroup tasks;
+	for (nat i = 0; i < threads - 1; i++)
+		tasks.spawn(&TreeWalk::main, walk);
+	walk.main();
+	tasks.wait();
+}
+
+const vector<Path> &FileCache::children(const Path &dir) {
+	{
+		Lock::Guard z(lock);
+		DirMap::const_iterator i = dirs.find(dir);
+		if (i != dirs.end()) {
+			hitCount++;
+			return *i->second;
+		}
+		missCount++;
+		listCount++;
+	}
+
+	vector<Path> *result = new vector<Path>(dir.children());
+
+	Lock::Guard z(lock);
+	pair<DirMap::iterator, bool> r = dirs.insert(make_pair(dir, result));
+	if (!r.second) {
+		// Someone else listed it while we did.
+		delete result;
+	}
+	return *r.first->second;
+}
+
+void FileCache::retire(const Path &dir) {
+	DirMap::iterator i = dirs.find(dir);
+	if (i == dirs.end())
+		return;
+
+	retired << i->second;
+	dirs.erase(i);
+}
+
+void FileCache::createDir(const Path &dir) {
+	if (dir.isEmpty() || exists(dir))
+		return;
+
+	createDir(dir.parent());
+	dir.createDir();
+	invalidate(dir);
+}
+
+void FileCache::invalidate(const Path &path) {
+	PathId id = PathTable::id(path);
+	Lock::Guard z(lock);
+
+	known(id).valid = false;
+	retire(path);
+	retire(path.parent());
+}
+
+void FileCache::invalidate() {
+	Lock::Guard z(lock);
+
+	files.clear();
+	for (DirMap::iterator i = dirs.begin(); i != dirs.end(); ++i)
+		retired << i->second;
+	dirs.clear();
+}
+
+nat64 FileCache::hits() const {
+	Lock::Guard z(lock);
+	return hitCount;
+}
+
+nat64 FileCache::misses() const {
+	Lock::Guard z(lock);
+	return missCount;
+}
+
+nat64 FileCache::listings() const {
+	Lock::Guard z(lock);
+	return listCount;
+}
+
+ostream &operator <<(ostream &to, const FileCache &c) {
+	nat64 hits = c.hits(), misses = c.misses();
+	to << (hits + misses) << " file system queries, " << hits << " answered from the cache";
+	return to;
+}
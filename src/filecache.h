@@ -0,0 +1,123 @@
+#pragma once
+#include "path.h"
+#include "hash.h"
+#include "sync.h"
+#include "pathtable.h"
+
+/**
+ * Decides which directories to enter when walking a directory tree. Called from multiple threads.
+ */
+class WalkFilter {
+public:
+	virtual ~WalkFilter() {}
+
+	// Enter the directory 'dir'?
+	virtual bool enter(const Path &dir) const = 0;
+};
+
+/**
+ * Snapshot of the metadata of the files in the file system.
+ *
+ * Remembers the result of all queries about files (existence, modification time, size and whether
+ * it is a directory) and the contents of directories, so that each file is only examined once
+ * during a build. It is owned by the Project (or by the Target when building a single target) and
+ * used in all phases of the build.
+ *
+ * Since the file system is assumed not to change during the build, anything modified by mymake
+ * itself (e.g. outputs of commands) needs to be invalidated explicitly.
+ *
+ * When it is known in advance that many files will be examined (e.g. all files in the include
+ * cache), 'prefetch' examines them using multiple threads. This is much faster than examining them
+ * one at a time on file systems with a high latency, such as NFS.
+ *
+ * Note: Since targets are examined and compiled in parallel, this class is thread-safe.
+ */
+class FileCache : NoCopy {
+public:
+	// Create.
+	FileCache();
+
+	// Destroy.
+	~FileCache();
+
+	// Get information about a file.
+	FileInfo info(const Path &path);
+
+	// Convenience functions.
+	bool exists(const Path &path) { return info(path).exists; }
+	Timestamp mTime(const Path &path) { return info(path).mTime; }
+	nat64 size(const Path &path) { return info(path).size; }
+	bool isDir(const Path &path) { return info(path).isDir; }
+
+	// Examine all 'paths' that are not already in the cache, using multiple threads. Returns when all
+	// of them are in the cache.
+	void prefetch(const vector<Path> &paths);
+
+	// List all directories in the tree rooted at 'root' using multiple threads, so that later calls
+	// to 'children' and 'info' for the directories hit the cache. Directories rejected by 'filter'
+	// (if not null) are not entered.
+	void prefetchTree(const Path &root, const WalkFilter *filter);
+
+	// Set the number of threads used by 'prefetch' and 'prefetchTree'. 1 disables the use of threads.
+	static void setPrefetchThreads(nat threads);
+
+	// Get the contents of a directory (like Path::children). The returned listing stays valid until
+	// the cache is destroyed, even if the directory is invalidated.
+	const vector<Path> &children(const Path &dir);
+
+	// Create a directory and any parent directories, if they do not already exist.
+	void createDir(const Path &dir);
+
+	// Forget anything we know about 'path', and the contents of its parent directory. Call whenever
+	// mymake modifies a file.
+	void invalidate(const Path &path);
+
+	// Forget everything. Used when something we do not know about may have modified files.
+	void invalidate();
+
+	// Number of queries answered from the cache, and number of queries that had to ask the file
+	// system.
+	nat64 hits() const;
+	nat64 misses() const;
+
+	// Number of directories listed. Included in 'misses'.
+	nat64 listings() const;
+
+private:
+	// Lock for all members.
+	mutable Lock lock;
+
+	// Information about a file.
+	class Known {
+	public:
+		Known() : info(false), valid(false) {}
+
+		// Information.
+		FileInfo info;
+
+		// Is 'info' valid?
+		bool valid;
+	};
+
+	// Known files, indexed by PathId.
+	vector<Known> files;
+
+	// Get the entry for 'id', growing 'files' if needed.
+	Known &known(PathId id);
+
+	// Known directory contents.
+	typedef FlatMap<Path, vector<Path> *> DirMap;
+	DirMap dirs;
+
+	// Listings that have been invalidated. Kept since someone may still use them.
+	vector<vector<Path> *> retired;
+
+	// Forget the listing of 'dir'.
+	void retire(const Path &dir);
+
+	// Counters.
+	nat64 hitCount, missCount, listCount;
+};
+
+// Output.
+ostream &operator <<(ostream &to, const FileCache &c);
@@ -0,0 +1,123 @@
+#include "std.h"
+#include "findcache.h"
+
+FindCache::FindCache(FileCache &fileCache) : fileCache(fileCache) {}
+
+void FindCache::clear() {
+	files.clear();
+	dependsOn.clear();
+	output = Path();
+	times.clear();
+}
+
+void FindCache::watch(const Path &path) {
+	if (times.count(path))
+		return;
+
+	times.insert(std::make_pair(path, fileCache.mTime(path)));
+}
+
+bool FindCache::load(const Path &from, nat64 signature) {
+	clear();
+
+	ifstream src(toS(from).c_str());
+	String line;
+
+	// Check the signature first.
+	if (!getline(src, line) || line != "s" + toS(signature))
+		return false;
+
+	// Read everything, so that we can examine all watched paths at once.
+	vector<String> lines;
+	vector<Path> watched;
+	while (getline(src, line)) {
+		if (line.empty())
+			continue;
+
+		if (line[0] == 'w') {
+			nat space = line.find(' ');
+			if (space != String::npos)
+				watched << Path(line.substr(space + 1));
+		}
+		lines << line;
+	}
+
+	fileCache.prefetch(watched);
+
+	for (nat l = 0; l < lines.size(); l++) {
+		const String &line = lines[l];
+		char type = line[0];
+		String rest = line.substr(1);
+
+		switch (type) {
+		case 'w': {
+			// Watched path.
+			nat space = rest.find(' ');
+			if (space == String::npos)
+				break;
+
+			Path path(rest.substr(space + 1));
+			Timestamp time(to<nat64>(rest.substr(0, space)));
+			if (fileCache.mTime(path) != time) {
+				DEBUG(path << " was modified. Need to find dependencies again.", VERBOSE);
+				clear();
+				return false;
+			}
+
+			times.insert(std::make_pair(path, time));
+			break;
+		}
+		case 'f':
+			if (rest.size() < 3)
+				break;
+			files.push_back(File(Path(rest.substr(3)), rest[0] == 'p', rest[1] == 'a'));
+			break;
+		case 't':
+			dependsOn.insert(rest);
+			break;
+		case 'o':
+			output = Path(rest);
+			break;
+		}
+	}
+
+	if (files.empty()) {
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+void FindCache::save(const Path &to, nat64 signature) const {
+	for (TimeMap::const_iterator i = times.begin(); i != times.end(); ++i) {
+		if (started - i->second < Timespan::ms(2000)) {
+			DEBUG(i->first << " was modified recently. Not saving the result of finding dependencies.", VERBOSE);
+			if (to.exists())
+				to.deleteFile();
+			return;
+		}
+	}
+
+	ofstream dest(toS(to).c_str());
+
+	dest << "s" << signature << endl;
+
+	// Keep ordering stable in the file.
+	vector<std::pair<Path, Timestamp>> ordered(times.begin(), times.end());
+	std::sort(ordered.begin(), ordered.end());
+
+	for (nat i = 0; i < ordered.size(); i++) {
+		dest << "w" << ordered[i].second.time << ' ' << ordered[i].first << endl;
+	}
+
+	for (nat i = 0; i < files.size(); i++) {
+		const File &f = files[i];
+		dest << "f" << (f.pch ? 'p' : '-') << (f.autoFound ? 'a' : '-') << ' ' << f.file << endl;
+	}
+
+	for (set<String>::const_iterator i = dependsOn.begin(); i != dependsOn.end(); ++i)
+		dest << "t" << *i << endl;
+
+	dest << "o" << output << endl;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "path.h"
+#include "hash.h"
+#include "filecache.h"
+
+/**
+ * Persisted result of finding the files of a target (Target::find).
+ *
+ * Finding the files to compile requires listing directories and reading the includes of all
+ * files. Since the result only depends on the configuration of the target, the contents of the
+ * directories that were listed and the includes of the files that were examined, we store the
+ * result together with the modification time of all these files and directories. The next time,
+ * we only need to check the modification times (one stat per file or directory) to know if the
+ * previous result is still valid.
+ *
+ * The configuration is represented by a signature, computed by the caller.
+ */
+class FindCache : NoCopy {
+public:
+	// Create an empty cache. Uses 'fileCache' to examine files.
+	FindCache(FileCache &fileCache);
+
+	// A file to compile.
+	class File {
+	public:
+		File(const Path &file, bool pch, bool autoFound) : file(file), pch(pch), autoFound(autoFound) {}
+
+		// The file.
+		Path file;
+
+		// Precompiled header?
+		bool pch;
+
+		// Found by the automatic search?
+		bool autoFound;
+	};
+
+	// Files to compile, in order.
+	vector<File> files;
+
+	// Projects we depend on.
+	set<String> dependsOn;
+
+	// Output file.
+	Path output;
+
+	// Load the cache from 'from'. Returns true if it was created with the same signature, and none of
+	// the watched files and directories have been modified since. Otherwise, the cache is left empty.
+	bool load(const Path &from, nat64 signature);
+
+	// Save the cache. Nothing is saved (and any previous cache in 'to' is removed) if any of the
+	// watched paths were modified close to when we started, since the modification time has a
+	// limited resolution and the modification might have happened after we examined them.
+	void save(const Path &to, nat64 signature) const;
+
+	// Clear the result and all watched paths.
+	void clear();
+
+	// Make the result depend on the contents of 'path'. Records the current modification time of
+	// 'path', so this should be called before 'path' is examined.
+	void watch(const Path &path);
+
+	// Number of watched paths.
+	inline nat watched() const { return nat(times.size()); }
+
+private:
+	// File system.
+	FileCache &fileCache;
+
+	// Modification times of watched files and directories.
+	typedef FlatMap<Path, Timestamp> TimeMap;
+	TimeMap times;
+
+	// Time when this run started.
+	Timestamp started;
+};
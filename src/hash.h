@@ -62,3 +62,278 @@ inline hash_set<T> &operator <<(hash_set<T> &to, const T &elem) {
 	return to;
 }
 
+
+
+/**
+ * Hash function and equality for FlatMap and FlatSet.
+ *
+ * Specializations may add overloads of 'hash' and 'equal' that accept other types than the key. The
+ * containers then accept these types in lookups, without creating a key (heterogeneous lookup). An
+ * object of another type has to have the same hash as the key it is equal to.
+ */
+template <class T>
+struct FlatHash {
+	static size_t hash(const T &v) {
+#ifdef USE_STDEXT
+		return stdext::hash_value(v);
+#else
+		return std::hash<T>()(v);
+#endif
+	}
+
+	static bool equal(const T &a, const T &b) {
+		return a == b;
+	}
+};
+
+/**
+ * Paths can be looked up by their string representation.
+ */
+template <>
+struct FlatHash<Path> {
+	static size_t hash(const Path &p) { return p.hash(); }
+	static size_t hash(const String &s) { return Path::hash(s); }
+
+	static bool equal(const Path &a, const Path &b) { return a == b; }
+	static bool equal(const Path &a, const String &b) { return Path::equal(a.str(), b); }
+};
+
+/**
+ * Hash table using open addressing, used to implement FlatMap and FlatSet.
+ *
+ * Elements are stored contiguously in a vector, in insertion order unless elements are erased. The
+ * table itself only contains the index of each element together with 32 bits of its hash, and uses
+ * linear probing. This means that inserting elements does not allocate memory except when the
+ * containers grow, and that lookups mostly touch a single cache line in the table.
+ *
+ * Note: Unlike std::unordered_map, references to elements are invalidated by insertions, and erasing
+ * an element moves the last element to its position.
+ */
+template <class K, class E, class H>
+class FlatTable {
+public:
+	typedef E value_type;
+	typedef typename vector<E>::iterator iterator;
+	typedef typename vector<E>::const_iterator const_iterator;
+
+	// Create.
+	FlatTable() : bits(0) {}
+
+	// Size.
+	size_t size() const { return elems.size(); }
+	bool empty() const { return elems.empty(); }
+
+	// Iteration.
+	iterator begin() { return elems.begin(); }
+	iterator end() { return elems.end(); }
+	const_iterator begin() const { return elems.begin(); }
+	const_iterator end() const { return elems.end(); }
+
+	// Find an element. 'Q' is either 'K' or a type supported by 'H'.
+	template <class Q>
+	iterator find(const Q &key) {
+		nat slot = probe(key, mix(H::hash(key)));
+		if (slot == none || !slots[slot].elem)
+			return elems.end();
+		return elems.begin() + (slots[slot].elem - 1);
+	}
+
+	template <class Q>
+	const_iterator find(const Q &key) const {
+		nat slot = probe(key, mix(H::hash(key)));
+		if (slot == none || !slots[slot].elem)
+			return elems.end();
+		return elems.begin() + (slots[slot].elem - 1);
+	}
+
+	template <class Q>
+	size_t count(const Q &key) const {
+		return find(key) == elems.end() ? 0 : 1;
+	}
+
+	// Insert an element, unless an element with the same key is already present. Returns the element
+	// with the key, and whether it was inserted.
+	std::pair<iterator, bool> insert(const E &elem) {
+		nat h = mix(H::hash(keyOf(elem)));
+		nat slot = probe(keyOf(elem), h);
+		if (slot != none && slots[slot].elem)
+			return std::make_pair(elems.begin() + (slots[slot].elem - 1), false);
+
+		// Keep the load factor below 3/4.
+		if (slot == none || (elems.size() + 1) * 4 > slots.size() * 3) {
+			grow();
+			slot = probe(keyOf(elem), h);
+		}
+
+		elems.push_back(elem);
+		slots[slot].hash = h;
+		slots[slot].elem = nat(elems.size());
+		return std::make_pair(elems.end() - 1, true);
+	}
+
+	// Erase an element.
+	void erase(iterator at) {
+		nat id = nat(at - elems.begin());
+		removeSlot(slotOf(id));
+
+		// Move the last element into the hole.
+		nat last = nat(elems.size() - 1);
+		if (id != last) {
+			slots[slotOf(last)].elem = id + 1;
+			std::swap(elems[id], elems[last]);
+		}
+		elems.pop_back();
+	}
+
+	size_t erase(const K &key) {
+		iterator i = find(key);
+		if (i == elems.end())
+			return 0;
+		erase(i);
+		return 1;
+	}
+
+	// Remove all elements.
+	void clear() {
+		elems.clear();
+		for (nat i = 0; i < slots.size(); i++)
+			slots[i].elem = 0;
+	}
+
+	// Make room for 'n' elements.
+	void reserve(size_t n) {
+		while (n * 4 > slots.size() * 3)
+			grow();
+		elems.reserve(n);
+	}
+
+protected:
+	// Elements.
+	vector<E> elems;
+
+	// Slot in the table.
+	struct Slot {
+		// Top 32 bits of the (mixed) hash.
+		nat hash;
+
+		// Index of the element + 1. Zero if empty.
+		nat elem;
+	};
+
+	// The table. Its size is 2^bits.
+	vector<Slot> slots;
+	nat bits;
+
+	// No slot.
+	enum { none = 0xFFFFFFFF };
+
+	// Get the key of an element.
+	static const K &keyOf(const K &k) { return k; }
+	template <class V>
+	static const K &keyOf(const std::pair<K, V> &p) { return p.first; }
+
+	// Mix the bits of a hash, and keep the top 32 bits. The bits of the hash functions we use are
+	// not very well distributed.
+	static nat mix(size_t h) {
+		if (sizeof(size_t) > 4)
+			return nat((nat64(h) * 0x9E3779B97F4A7C15ULL) >> 32);
+		else
+			return nat(h) * 0x9E3779B9u;
+	}
+
+	// First slot for a hash.
+	nat home(nat h) const {
+		return h >> (32 - bits);
+	}
+
+	// Find the slot containing 'key', or the empty slot where it should be inserted. Returns 'none'
+	// if the table is empty.
+	template <class Q>
+	nat probe(const Q &key, nat h) const {
+		if (slots.empty())
+			return none;
+
+		nat mask = nat(slots.size() - 1);
+		for (nat i = home(h); ; i = (i + 1) & mask) {
+			const Slot &s = slots[i];
+			if (!s.elem)
+				return i;
+			if (s.hash == h && H::equal(keyOf(elems[s.elem - 1]), key))
+				return i;
+		}
+	}
+
+	// Find the slot containing element number 'id'.
+	nat slotOf(nat id) const {
+		nat mask = nat(slots.size() - 1);
+		nat i = home(mix(H::hash(keyOf(elems[id]))));
+		while (slots[i].elem != id + 1)
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	// Remove the element at 'slot' from the table, shifting any following elements back so that
+	// they are still reachable.
+	void removeSlot(nat slot) {
+		nat mask = nat(slots.size() - 1);
+		nat hole = slot;
+		for (nat i = (hole + 1) & mask; slots[i].elem; i = (i + 1) & mask) {
+			// Can the element at 'i' be moved to 'hole'? Only if its home is not in (hole, i].
+			nat h = home(slots[i].hash);
+			bool stays = (hole <= i) ? (hole < h && h <= i) : (hole < h || h <= i);
+			if (stays)
+				continue;
+
+			slots[hole] = slots[i];
+			hole = i;
+		}
+		slots[hole].elem = 0;
+	}
+
+	// Double the size of the table.
+	void grow() {
+		vector<Slot> old(max(size_t(16), slots.size() * 2));
+		old.swap(slots);
+		bits = 0;
+		while ((size_t(1) << bits) < slots.size())
+			bits++;
+
+		nat mask = nat(slots.size() - 1);
+		for (nat i = 0; i < old.size(); i++) {
+			if (!old[i].elem)
+				continue;
+
+			nat to = home(old[i].hash);
+			while (slots[to].elem)
+				to = (to + 1) & mask;
+			slots[to] = old[i];
+		}
+	}
+};
+
+/**
+ * Hash map using open addressing. See FlatTable.
+ */
+template <class K, class V, class H = FlatHash<K> >
+class FlatMap : public FlatTable<K, std::pair<K, V>, H> {
+public:
+	// Get the value for 'key', inserting a default-constructed value if it does not exist.
+	V &operator [](const K &key) {
+		typename FlatMap::iterator i = this->find(key);
+		if (i == this->end())
+			i = this->insert(std::make_pair(key, V())).first;
+		return i->second;
+	}
+};
+
+/**
+ * Hash set using open addressing. See FlatTable.
+ */
+template <class K, class H = FlatHash<K> >
+class FlatSet : public FlatTable<K, K, H> {};
+
+template <class T>
+inline FlatSet<T> &operator <<(FlatSet<T> &to, const T &elem) {
+	to.insert(elem);
+	return to;
+}
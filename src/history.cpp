@@ -0,0 +1,293 @@
+#include "std.h"
+#include "history.h"
+#include "buildstats.h"
+
+// When the history grows larger than this, the oldest builds are removed so that about half of it
+// remains.
+static const nat64 maxSize = 8 * 1024 * 1024;
+
+// Number of previous builds the median is computed from.
+static const nat window = 10;
+
+// Number of previous builds needed before we report regressions.
+static const nat minSamples = 3;
+
+// Smaller increases than this are not reported as regressions, since they are likely noise.
+static const Timespan minIncrease = Timespan::ms(50);
+
+// Number of builds and files shown in lists.
+static const nat showCount = 10;
+
+/**
+ * The file contains one line for each build, followed by one line for each command:
+ *
+ * b <time> <1 if successful> <total time> <time to find dependencies>
+ * c <time> <file>    (compiling a file)
+ * l <time> <output>  (linking a target)
+ * s <time> <step>    (pre- or post-build step)
+ *
+ * Durations are in microseconds. Names are relative to the project root.
+ */
+
+// Characters used for the kinds of commands.
+static const char kindChars[] = { 'c', 'l', 's' };
+
+void BuildHistory::append(const Path &file, bool ok, const Timespan &find, const Timespan &total) {
+	vector<BuildStats::Command> commands = BuildStats::commands();
+
+	std::ostringstream out;
+	out << "b " << Timestamp().time << ' ' << (ok ? 1 : 0) << ' ' << total.micros() << ' ' << find.micros() << '\n';
+	for (nat i = 0; i < commands.size(); i++) {
+		const BuildStats::Command &c = commands[i];
+
+		// Failed commands did not do all of their work.
+		if (c.result != 0)
+			continue;
+
+		out << kindChars[c.kind] << ' ' << c.stats.wallTime.micros() << ' ' << c.name << '\n';
+	}
+
+	file.parent().createDir();
+	{
+		ofstream dst(toS(file).c_str(), std::ios::app);
+		dst << out.str();
+	}
+
+	if (file.info().size <= maxSize)
+		return;
+
+	// Too large. Keep the most recent builds.
+	vector<String> lines;
+	{
+		ifstream src(toS(file).c_str());
+		String line;
+		while (getline(src, line))
+			lines << line;
+	}
+
+	nat64 kept = 0;
+	nat first = lines.size();
+	while (first > 0 && kept < maxSize / 2) {
+		first--;
+		kept += lines[first].size() + 1;
+	}
+
+	// Start at a build.
+	while (first < lines.size() && (lines[first].empty() || lines[first][0] != 'b'))
+		first++;
+
+	ofstream dst(toS(file).c_str());
+	for (nat i = first; i < lines.size(); i++)
+		dst << lines[i] << '\n';
+}
+
+/**
+ * A build in the history.
+ */
+class PastBuild {
+public:
+	PastBuild() : time(0), ok(false), compiled(0), linked(0) {}
+
+	// When the build finished.
+	Timestamp time;
+
+	// Successful?
+	bool ok;
+
+	// Total time and time to find dependencies.
+	Timespan total, find;
+
+	// Number of files compiled and targets linked.
+	nat compiled, linked;
+};
+
+/**
+ * Duration of a command in one build.
+ */
+class Sample {
+public:
+	Sample(nat build, const Timespan &time) : build(build), time(time) {}
+
+	// Index of the build.
+	nat build;
+
+	// Duration.
+	Timespan time;
+};
+
+typedef map<String, vector<Sample>> SampleMap;
+
+// Median of the durations of samples [from, to[.
+static Timespan median(const vector<Sample> &samples, nat from, nat to) {
+	vector<Timespan> times;
+	for (nat i = from; i < to; i++)
+		times << samples[i].time;
+
+	if (times.empty())
+		return Timespan();
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+// Median of the last 'window' samples before 'before'.
+static Timespan previousMedian(const vector<Sample> &samples, nat before) {
+	return median(samples, before > window ? before - window : 0, before);
+}
+
+/**
+ * A file whose compile time regressed.
+ */
+class Regression {
+public:
+	Regression(const String &name, const Sample &latest, const Timespan &median) :
+		name(name), latest(latest), median(median) {}
+
+	// File.
+	String name;
+
+	// Latest compilation.
+	Sample latest;
+
+	// Median of the previous builds.
+	Timespan median;
+
+	// Order by build, and by increase within each build.
+	bool operator <(const Regression &o) const {
+		if (latest.build != o.latest.build)
+			return latest.build < o.latest.build;
+		return (latest.time - median) > (o.latest.time - o.median);
+	}
+};
+
+// Load the history in 'file'.
+static void load(const Path &file, vector<PastBuild> &builds, SampleMap &compiles, SampleMap &links) {
+	ifstream src(toS(file).c_str());
+	String line;
+	while (getline(src, line)) {
+		if (line.size() < 2)
+			continue;
+
+		std::istringstream in(line.substr(2));
+		if (line[0] == 'b') {
+			nat64 time = 0;
+			int ok = 0;
+			int64 total = 0, find = 0;
+			in >> time >> ok >> total >> find;
+
+			PastBuild b;
+			b.time = Timestamp(time);
+			b.ok = ok != 0;
+			b.total = Timespan::us(total);
+			b.find = Timespan::us(find);
+			builds << b;
+			continue;
+		}
+
+		// Commands before the first build are ignored.
+		if (builds.empty())
+			continue;
+
+		int64 time = 0;
+		in >> time;
+		String name;
+		if (!getline(in, name) || name.size() < 2)
+			continue;
+		name = name.substr(1);
+
+		nat build = builds.size() - 1;
+		if (line[0] == 'c') {
+			compiles[name] << Sample(build, Timespan::us(time));
+			builds[build].compiled++;
+		} else if (line[0] == 'l') {
+			links[name] << Sample(build, Timespan::us(time));
+			builds[build].linked++;
+		}
+	}
+}
+
+void BuildHistory::show(const Path &file, nat threshold) {
+	vector<PastBuild> builds;
+	SampleMap compiles, links;
+	load(file, builds, compiles, links);
+
+	if (builds.empty()) {
+		PLN("No build history in " << file);
+		return;
+	}
+
+	PLN("-- Build history: " << builds.size() << " builds since " << builds[0].time << " --");
+
+	PLN("Recent builds:");
+	for (nat i = builds.size() > showCount ? builds.size() - showCount : 0; i < builds.size(); i++) {
+		const PastBuild &b = builds[i];
+		PLN("  " << b.time << (b.ok ? "  ok      " : "  failed  ") << b.total
+			<< " (finding dependencies " << b.find << ", compiled " << b.compiled << ", linked " << b.linked << ")");
+	}
+
+	// Slowest files, by the median of their recent compile times.
+	{
+		vector<pair<Timespan, String>> slowest;
+		for (SampleMap::const_iterator i = compiles.begin(); i != compiles.end(); ++i)
+			slowest << make_pair(previousMedian(i->second, i->second.size()), i->first);
+		std::sort(slowest.rbegin(), slowest.rend());
+
+		if (!slowest.empty())
+			PLN("Slowest files (median of the last " << window << " compilations):");
+		for (nat i = 0; i < min(slowest.size(), showCount); i++)
+			PLN("  " << slowest[i].first << ": " << slowest[i].second);
+	}
+
+	// Link times.
+	{
+		vector<pair<Timespan, String>> slowest;
+		for (SampleMap::const_iterator i = links.begin(); i != links.end(); ++i)
+			slowest << make_pair(i->second.back().time, i->first);
+		std::sort(slowest.rbegin(), slowest.rend());
+
+		if (!slowest.empty())
+			PLN("Slowest links (latest, and median of the previous " << window << "):");
+		for (nat i = 0; i < min(slowest.size(), showCount); i++) {
+			const vector<Sample> &s = links[slowest[i].second];
+			std::ostringstream median;
+			if (s.size() > 1)
+				median << ", median " << previousMedian(s, s.size() - 1);
+			PLN("  " << slowest[i].first << median.str() << ": " << slowest[i].second);
+		}
+	}
+
+	// Regressions. We compare the latest compilation of each file to the previous ones.
+	vector<Regression> regressions;
+	for (SampleMap::const_iterator i = compiles.begin(); i != compiles.end(); ++i) {
+		const vector<Sample> &s = i->second;
+		if (s.size() <= minSamples)
+			continue;
+
+		const Sample &latest = s.back();
+		Timespan median = previousMedian(s, s.size() - 1);
+		if (latest.time - median < minIncrease)
+			continue;
+		if (latest.time.micros() * 100 <= median.micros() * int64(100 + threshold))
+			continue;
+
+		regressions << Regression(i->first, latest, median);
+	}
+	std::sort(regressions.begin(), regressions.end());
+
+	if (regressions.empty()) {
+		PLN("No compile times regressed more than " << threshold << "% compared to the median of previous builds.");
+		return;
+	}
+
+	PLN("Compile times that regressed more than " << threshold << "% compared to the median of previous builds:");
+	for (nat i = 0; i < regressions.size(); i++) {
+		const Regression &r = regressions[i];
+		if (i == 0 || regressions[i - 1].latest.build != r.latest.build)
+			PLN("  In the build at " << builds[r.latest.build].time << ":");
+
+		int64 increase = 0;
+		if (r.median.micros() > 0)
+			increase = (r.latest.time - r.median).micros() * 100 / r.median.micros();
+		PLN("    " << r.name << ": " << r.latest.time << ", median " << r.median << " (+" << increase << "%)");
+	}
+}
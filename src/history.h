@@ -0,0 +1,21 @@
+#pragma once
+#include "path.h"
+#include "timespan.h"
+
+/**
+ * History of previous builds, kept in an append-only file in the build directory. For each build,
+ * it contains the outcome, the total time, the time spent finding dependencies, and the time taken
+ * by each command that succeeded (as collected by BuildStats).
+ *
+ * The history is used by 'mm --history' to show trends, and to find files whose compile time has
+ * regressed compared to previous builds (e.g. after a change to a header they include).
+ */
+class BuildHistory {
+public:
+	// Append the current build to 'file'.
+	static void append(const Path &file, bool ok, const Timespan &find, const Timespan &total);
+
+	// Show the history in 'file'. Compile times that are more than 'threshold' percent above the
+	// median of previous builds are reported as regressions.
+	static void show(const Path &file, nat threshold);
+};
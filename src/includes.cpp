@@ -1,15 +1,23 @@
 #include "std.h"
 #include "includes.h"
-#include "uniquequeue.h"
+#include "buildstats.h"
+
+// Get the element for 'id' in 'v', growing 'v' if needed.
+template <class T>
+static T &slot(vector<T> &v, PathId id) {
+	if (id >= v.size())
+		v.resize(id + 1);
+	return v[id];
+}
 
 IncludeInfo::IncludeInfo() : ignored(false) {}
 
 IncludeInfo::IncludeInfo(const Path &file, bool ignored) : file(file), ignored(ignored) {}
 
-Timestamp IncludeInfo::lastModified(TimeCache &cache) const {
-	Timestamp r = cache.mTime(file);
-	for (PathSet::const_iterator i = includes.begin(); i != includes.end(); ++i)
-		r = max(r, cache.mTime(*i));
+Timestamp IncludeInfo::lastModified(FileCache &files) const {
+	Timestamp r = files.mTime(file);
+	for (nat i = 0; i < includes.size(); i++)
+		r = max(r, files.mTime(PathTable::path(includes[i])));
 	return r;
 }
 
@@ -17,13 +25,18 @@ ostream &operator <<(ostream &to, const IncludeInfo &i) {
 	to << i.file << ": ";
 	if (!i.firstInclude.empty())
 		to << "(first: " << i.firstInclude << ") ";
-	join(to, i.includes);
+	for (nat j = 0; j < i.includes.size(); j++) {
+		if (j > 0)
+			to << ", ";
+		to << PathTable::path(i.includes[j]);
+	}
 	return to;
 }
 
-Includes::Includes(const Path &wd, const vector<Path> &ip) : wd(wd), includePaths(ip) {}
+Includes::Includes(const Path &wd, const vector<Path> &ip, FileCache &files) :
+	wd(wd), files(files), includePaths(ip), visitMark(0) {}
 
-Includes::Includes(const Path &wd, const Config &config) : wd(wd) {
+Includes::Includes(const Path &wd, const Config &config, FileCache &files) : wd(wd), files(files), visitMark(0) {
 	vector<String> paths = config.getArray("include");
 	for (nat i = 0; i < paths.size(); i++) {
 		includePaths << Path(paths[i]).makeAbsolute(wd);
@@ -31,26 +44,29 @@ Includes::Includes(const Path &wd, const Config &config) : wd(wd) {
 }
 
 const IncludeInfo &Includes::info(const Path &file) {
-	RecInfoMap::const_iterator i = recCache.find(file);
-	if (i == recCache.end()) {
-		IncludeInfo &info = recCache[file];
-		createInfo(file, info);
-		return info;
-	} else {
-		return i->second;
+	PathId id = PathTable::id(file);
+	if (id >= recCache.size() || !recCache[id]) {
+		IncludeInfo *info = arena.create<IncludeInfo>();
+		createInfo(id, *info);
+		slot(recCache, id) = info;
 	}
+	return *recCache[id];
 }
 
-void Includes::createInfo(const Path &file, IncludeInfo &result) {
-	result.file = file;
+void Includes::createInfo(PathId file, IncludeInfo &result) {
+	result.file = PathTable::path(file);
 	result.ignored = false;
 
-	UniqueQueue<Path> toExplore;
+	nat mark = ++visitMark;
+	slot(visited, file) = mark;
+	bool selfIncluded = false;
+
+	toExplore.clear();
+	closure.clear();
 	toExplore << file;
 
-	while (toExplore.any()) {
-		Path f = toExplore.pop();
-		const Info &at = fileInfo(f);
+	for (nat next = 0; next < toExplore.size(); next++) {
+		const Info &at = fileInfo(toExplore[next]);
 
 		// Update firstInclude if needed.
 		if (result.firstInclude.empty())
@@ -64,22 +80,32 @@ void Includes::createInfo(const Path &file, IncludeInfo &result) {
 			continue;
 
 		// Add recursively included headers.
-		for (set<Path>::const_iterator i = at.includes.begin(), end = at.includes.end(); i != end; ++i) {
-			toExplore << *i;
-			result.includes << *i;
+		for (nat i = 0; i < at.includes.size(); i++) {
+			PathId inc = at.includes[i];
+			nat &seen = slot(visited, inc);
+			if (seen != mark) {
+				seen = mark;
+				toExplore << inc;
+				closure << inc;
+			} else if (inc == file && !selfIncluded) {
+				// Some header includes 'file' again.
+				selfIncluded = true;
+				closure << inc;
+			}
 		}
 	}
+
+	if (!closure.empty())
+		result.includes = IncludeInfo::PathSet(arena.copy(&closure[0], closure.size()), nat(closure.size()));
 }
 
-const Includes::Info &Includes::fileInfo(const Path &file) {
-	InfoMap::iterator i = cache.find(file);
-	if (i == cache.end()) {
-		Info &result = cache[file];
-		createFileInfo(file, result);
-		return result;
-	} else {
-		return i->second;
+const Includes::Info &Includes::fileInfo(PathId file) {
+	if (file >= cache.size() || !cache[file]) {
+		Info *result = arena.create<Info>();
+		createFileInfo(file, *result);
+		slot(cache, file) = result;
 	}
+	return *cache[file];
 }
 
 static bool isInclude(const String &line, String &out) {
@@ -119,8 +145,9 @@ static bool isBlank(const String &line) {
 	return true;
 }
 
-void Includes::createFileInfo(const Path &file, Info &r) {
-	r = Info(file);
+void Includes::createFileInfo(PathId id, Info &r) {
+	const Path &file = PathTable::path(id);
+	r = Info(id, files.mTime(file));
 
 	// Ignored?
 	if (ignored(file)) {
@@ -128,6 +155,8 @@ void Includes::createFileInfo(const Path &file, Info &r) {
 		return;
 	}
 
+	BuildStats::count(BuildStats::scanned);
+
 	ifstream in(toS(file).c_str());
 	if (!in) {
 		PLN(file << ":1: Failed to open file.");
@@ -144,7 +173,9 @@ void Includes::createFileInfo(const Path &file, Info &r) {
 			try {
 				if (first)
 					r.firstInclude = include;
-				r.includes << resolveInclude(file, lineNr, include);
+				PathId inc = PathTable::id(resolveInclude(file, lineNr, include));
+				if (std::find(r.includes.begin(), r.includes.end(), inc) == r.includes.end())
+					r.includes << inc;
 			} catch (const IncludeError &e) {
 				PLN(e.what());
 			}
@@ -162,12 +193,12 @@ void Includes::createFileInfo(const Path &file, Info &r) {
 
 Path Includes::resolveInclude(const Path &fromFile, nat lineNr, const String &src) const {
 	Path sameFolder = fromFile.parent() + Path(src);
-	if (sameFolder.exists())
+	if (files.exists(sameFolder))
 		return sameFolder;
 
 	for (nat i = 0; i < includePaths.size(); i++) {
 		Path p = includePaths[i] + Path(src);
-		if (p.exists())
+		if (files.exists(p))
 			return p;
 	}
 
@@ -211,15 +242,29 @@ void Includes::load(const Path &from) {
 			return;
 	}
 
-	// Include paths match, load the cache...
-
-	Info *current = null;
+	// Include paths match, read the rest of the cache so that we can examine all files at once.
+	vector<String> lines;
+	vector<Path> paths;
 
 	// The first line is already in 'line' since the previous loop reads one line too much.
 	do {
 		if (line.empty())
 			continue;
 
+		if (line[0] == '+') {
+			nat space = line.find(' ');
+			if (space != String::npos)
+				paths << Path(line.substr(space + 1));
+		}
+		lines << line;
+	} while (getline(src, line));
+
+	files.prefetch(paths);
+
+	Info *current = null;
+
+	for (nat l = 0; l < lines.size(); l++) {
+		const String &line = lines[l];
 		char type = line[0];
 		String rest = line.substr(1);
 
@@ -233,11 +278,16 @@ void Includes::load(const Path &from) {
 				continue;
 
 			Timestamp modified(to<nat64>(rest.substr(0, space)));
-			Info file(Path(rest.substr(space + 1)));
+			PathId id = PathTable::id(rest.substr(space + 1));
+			Info file(id, files.mTime(PathTable::path(id)));
 			if (file.lastModified <= modified) {
 				// Our cache is up to date!
-				current = &cache.insert(make_pair(file.file, file)).first->second;
+				Info *&c = slot(cache, id);
+				if (!c)
+					c = arena.create<Info>(file);
+				current = c;
 				current->valid = true;
+				BuildStats::count(BuildStats::cachedIncludes);
 			}
 
 			break;
@@ -248,11 +298,10 @@ void Includes::load(const Path &from) {
 			break;
 		case '-':
 			if (current)
-				current->includes.insert(Path(rest));
+				current->includes << PathTable::id(rest);
 			break;
 		}
-	} while (getline(src, line));
-
+	}
 }
 
 void Includes::save(const Path &to) const {
@@ -263,20 +312,25 @@ void Includes::save(const Path &to) const {
 		dest << "i" << includePaths[i] << endl;
 	}
 
-	// All data.
-	for (InfoMap::const_iterator i = cache.begin(); i != cache.end(); ++i) {
-		const Info &info = i->second;
+	// All data. Path ids depend on the order in which files were examined, so we sort by path to
+	// keep the file stable between runs.
+	vector<PathId> order;
+	for (nat i = 0; i < cache.size(); i++) {
+		// Skip files that did not exist, or were not accessible.
+		if (cache[i] && cache[i]->valid)
+			order << cache[i]->file;
+	}
+	std::sort(order.begin(), order.end(), &PathTable::less);
 
-		// Some file that did not exist, or was not accessible.
-		if (!info.valid)
-			continue;
+	for (nat i = 0; i < order.size(); i++) {
+		const Info &info = *cache[order[i]];
 
-		dest << "+" << info.lastModified.time << ' ' << info.file << endl;
+		dest << "+" << info.lastModified.time << ' ' << PathTable::path(info.file) << endl;
 		if (!info.firstInclude.empty())
 			dest << ">" << info.firstInclude << endl;
 
-		for (set<Path>::const_iterator i = info.includes.begin(); i != info.includes.end(); ++i) {
-			dest << "-" << *i << endl;
+		for (nat j = 0; j < info.includes.size(); j++) {
+			dest << "-" << PathTable::path(info.includes[j]) << endl;
 		}
 	}
 }
@@ -299,4 +353,5 @@ bool Includes::ignored(const Path &path) const {
 
 Includes::Info::Info() {}
 
-Includes::Info::Info(const Path &file) : file(file), lastModified(file.mTime()), ignored(false), valid(false) {}
+Includes::Info::Info(PathId file, Timestamp lastModified) :
+	file(file), lastModified(lastModified), ignored(false), valid(false) {}
@@ -3,7 +3,9 @@
 #include "hash.h"
 #include "config.h"
 #include "wildcard.h"
-#include "timecache.h"
+#include "filecache.h"
+#include "pathtable.h"
+#include "arena.h"
 
 /**
  * Error with includes.
@@ -32,15 +34,16 @@ public:
 	// The first included file (if any).
 	String firstInclude;
 
-	// All files included from this file.
-	typedef set<Path> PathSet;
+	// All files included from this file, in no particular order. Stored in the arena of the
+	// Includes object that created this object.
+	typedef Span<PathId> PathSet;
 	PathSet includes;
 
 	// Is this file ignored? (ie. not useful to look for headers inside?)
 	bool ignored;
 
 	// Compute the last modified date of all includes.
-	Timestamp lastModified(TimeCache &cache) const;
+	Timestamp lastModified(FileCache &files) const;
 };
 
 // Output.
@@ -49,11 +52,11 @@ ostream &operator <<(ostream &to, const IncludeInfo &i);
 /**
  * Keep a cache of all includes from specific files.
  */
-class Includes {
+class Includes : NoCopy {
 public:
-	// Give information on include paths.
-	Includes(const Path &wd, const vector<Path> &includePaths);
-	Includes(const Path &wd, const Config &config);
+	// Give information on include paths. 'files' is used to examine files.
+	Includes(const Path &wd, const vector<Path> &includePaths, FileCache &files);
+	Includes(const Path &wd, const Config &config, FileCache &files);
 
 	// Get includes, and latest modified time from one include.
 	const IncludeInfo &info(const Path &file);
@@ -80,6 +83,9 @@ private:
 	// Current working directory.
 	Path wd;
 
+	// File system.
+	FileCache &files;
+
 	// Include search paths. The root is always first.
 	vector<Path> includePaths;
 
@@ -88,16 +94,16 @@ private:
 	// information for other files.
 	struct Info {
 		Info();
-		Info(const Path &file);
+		Info(PathId file, Timestamp lastModified);
 
 		// File name.
-		Path file;
+		PathId file;
 
 		// First file included (if any).
 		String firstInclude;
 
-		// All files included from this file.
-		set<Path> includes;
+		// All files included from this file, in the order they appear.
+		vector<PathId> includes;
 
 		// The timestamp of the file last time we looked at it.
 		Timestamp lastModified;
@@ -109,21 +115,30 @@ private:
 		bool valid;
 	};
 
-	// Cache for the call to "info".
-	typedef hash_map<Path, IncludeInfo> RecInfoMap;
-	RecInfoMap recCache;
+	// Storage for 'recCache' and 'cache', and everything they refer to.
+	Arena arena;
+
+	// Cache for the call to "info", indexed by PathId. Null if not computed.
+	vector<IncludeInfo *> recCache;
 
 	// Create an includeinfo object.
-	void createInfo(const Path &file, IncludeInfo &out);
+	void createInfo(PathId file, IncludeInfo &out);
 
-	// Information about each file. If a file is in the cache, it is valid (ie. it is not too
-	// old). We save this cache to disk between runs of mymake.
-	typedef map<Path, Info> InfoMap;
-	InfoMap cache;
+	// Information about each file, indexed by PathId. Null if not examined. If a file is in the
+	// cache, it is valid (ie. it is not too old). We save this cache to disk between runs of mymake.
+	vector<Info *> cache;
 
 	// Get an Info struct for a specific entry, creating it if it does not already exist.
-	const Info &fileInfo(const Path &file);
+	const Info &fileInfo(PathId file);
 
 	// Create the file info to be inserted into the cache.
-	void createFileInfo(const Path &file, Info &out);
+	void createFileInfo(PathId file, Info &out);
+
+	// Files visited by 'createInfo', indexed by PathId. A file is visited if its entry is equal to
+	// 'visitMark', which is incremented for each traversal so that we don't need to clear it.
+	vector<nat> visited;
+	nat visitMark;
+
+	// Scratch space for 'createInfo'.
+	vector<PathId> toExplore, closure;
 };
@@ -0,0 +1,413 @@
+#include "std.h"
+#include "jobserver.h"
+#include "pipe.h"
+#include "thread.h"
+#include <cstring>
+
+// Token we write to jobservers we create, and return when we don't know which token we got. This
+// is what GNU make uses.
+static const char tokenChar = '+';
+
+// Find the value of the last --jobserver-auth (or the older --jobserver-fds) in MAKEFLAGS.
+static bool findAuth(const String &flags, String &out) {
+	static const char *names[] = { "--jobserver-auth=", "--jobserver-fds=" };
+
+	bool found = false;
+	nat foundAt = 0;
+	for (nat i = 0; i < ARRAY_COUNT(names); i++) {
+		nat pos = flags.rfind(names[i]);
+		if (pos == String::npos)
+			continue;
+		if (found && pos < foundAt)
+			continue;
+
+		found = true;
+		foundAt = pos;
+
+		nat start = pos + strlen(names[i]);
+		nat end = flags.find_first_of(" \t", start);
+		if (end == String::npos)
+			out = flags.substr(start);
+		else
+			out = flags.substr(start, end - start);
+	}
+
+	return found;
+}
+
+JobServer JobServer::me;
+
+void JobServer::init(nat slots, const String &mode, Env &env) {
+	if (me.active)
+		return;
+
+	if (mode == "no") {
+		DEBUG("Not using a jobserver since 'jobserver=no'.", VERBOSE);
+		return;
+	}
+
+	String flags;
+	env.get("MAKEFLAGS", flags);
+
+	String auth;
+	if (findAuth(flags, auth)) {
+		if (me.connect(auth)) {
+			me.active = true;
+			DEBUG("Using the jobserver from MAKEFLAGS: " << auth, INFO);
+			return;
+		}
+
+		// This happens when make did not consider us to be a recursive make. We create our own
+		// jobserver in that case, which overrides the one in MAKEFLAGS for our children.
+		DEBUG("The jobserver " << auth << " in MAKEFLAGS is not accessible. Mark the rule with '+' to share it.", PEDANTIC);
+	}
+
+	if (slots < 1)
+		slots = 1;
+
+	if (!me.create(slots, mode, auth)) {
+		WARNING("Failed to create a jobserver. Nested builds will not share job slots.");
+		return;
+	}
+
+	me.active = true;
+
+	if (!flags.empty())
+		flags += " ";
+	flags += "-j" + toS(slots) + " --jobserver-auth=" + auth;
+	env.set("MAKEFLAGS", flags);
+
+	DEBUG("Created a jobserver with " << slots << " slots: " << auth, INFO);
+}
+
+bool JobServer::acquire(void (*onAvailable)()) {
+	return me.acquireMe(onAvailable);
+}
+
+void JobServer::release() {
+	me.releaseMe();
+}
+
+void JobServer::shutdown() {
+	me.shutdownMe();
+}
+
+JobServer::~JobServer() {
+	shutdownMe();
+}
+
+bool JobServer::acquireMe(void (*notify)()) {
+	if (!active)
+		return true;
+
+	Lock::Guard z(tokenLock);
+	char token;
+	if (!spareTokens.empty()) {
+		token = spareTokens[spareTokens.size() - 1];
+		spareTokens.erase(spareTokens.size() - 1);
+	} else if (!takeToken(token)) {
+		// Let the watcher tell us when to try again.
+		onAvailable = notify;
+		wanted = true;
+		wantedCond.signal();
+
+		if (!watching) {
+			watching = true;
+			// Note: The thread keeps running after 'thread' is destroyed.
+			Thread thread;
+			thread.start(&JobServer::watch, *this);
+		}
+		return false;
+	}
+
+	heldTokens.push_back(token);
+	return true;
+}
+
+void JobServer::releaseMe() {
+	if (!active)
+		return;
+
+	Lock::Guard z(tokenLock);
+	char token = tokenChar;
+	if (!heldTokens.empty()) {
+		token = heldTokens[heldTokens.size() - 1];
+		heldTokens.erase(heldTokens.size() - 1);
+	}
+	putToken(token);
+
+	// We don't need more tokens right now, so let others use the spare ones.
+	for (nat i = 0; i < spareTokens.size(); i++)
+		putToken(spareTokens[i]);
+	spareTokens.clear();
+}
+
+void JobServer::shutdownMe() {
+	{
+		Lock::Guard z(tokenLock);
+		if (!active)
+			return;
+
+		// Return any tokens we are still holding, so that they are not lost.
+		String tokens = heldTokens + spareTokens;
+		for (nat i = 0; i < tokens.size(); i++)
+			putToken(tokens[i]);
+		heldTokens.clear();
+		spareTokens.clear();
+
+		active = false;
+		wantedCond.signal();
+	}
+
+	closeMe();
+}
+
+void JobServer::watch() {
+	while (true) {
+		{
+			Lock::Guard z(tokenLock);
+			while (active && !wanted)
+				wantedCond.wait(tokenLock);
+			if (!active)
+				return;
+		}
+
+		// Note: We may block here, so we must not hold any locks.
+		char token;
+		bool took = waitToken(token);
+
+		void (*notify)() = null;
+		{
+			Lock::Guard z(tokenLock);
+			if (took) {
+				if (active)
+					spareTokens.push_back(token);
+				else
+					putToken(token);
+			}
+
+			wanted = false;
+			if (active)
+				notify = onAvailable;
+		}
+
+		if (notify)
+			(*notify)();
+	}
+}
+
+#ifdef WINDOWS
+
+JobServer::JobServer() : active(false), wanted(false), onAvailable(null), watching(false), sema(NULL) {}
+
+bool JobServer::connect(const String &auth) {
+	sema = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE, auth.c_str());
+	return sema != NULL;
+}
+
+bool JobServer::create(nat slots, const String &, String &auth) {
+	// This is the naming scheme used by GNU make.
+	auth = "gmake_semaphore_" + toS(GetCurrentProcessId());
+
+	// Note: The maximum count has to be positive.
+	sema = CreateSemaphore(NULL, LONG(slots - 1), LONG(slots), auth.c_str());
+	return sema != NULL;
+}
+
+bool JobServer::takeToken(char &token) {
+	token = tokenChar;
+	return WaitForSingleObject(sema, 0) == WAIT_OBJECT_0;
+}
+
+bool JobServer::waitToken(char &token) {
+	token = tokenChar;
+	return WaitForSingleObject(sema, INFINITE) == WAIT_OBJECT_0;
+}
+
+void JobServer::putToken(char) {
+	ReleaseSemaphore(sema, 1, NULL);
+}
+
+void JobServer::closeMe() {
+	// The watcher may still be waiting for the semaphore, and returns the token it gets. We are
+	// about to exit, so leave the semaphore open for it.
+	if (watching)
+		return;
+
+	if (sema)
+		CloseHandle(sema);
+	sema = NULL;
+}
+
+#else
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+JobServer::JobServer() :
+	active(false), wanted(false), onAvailable(null), watching(false),
+	readFd(-1), writeFd(-1), sharedRead(-1), sharedWrite(-1), blocking(false) {}
+
+static bool validFd(int fd) {
+	return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+// Open a private, non-blocking file description of the read end of a pipe. Setting O_NONBLOCK on
+// the description we inherited would affect all other processes that use the jobserver. Returns
+// -1 if it is not possible (e.g. if /proc is not available).
+static int openPrivate(int fd) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+// Use the read end 'fd' of a pipe for reading tokens. Sets 'blocking' if we had to use 'fd' as is.
+static int prepareRead(int fd, bool &blocking) {
+	int r = openPrivate(fd);
+	if (r >= 0)
+		return r;
+
+	// No luck. We need to use the shared description. Reading from it might block if someone else
+	// grabs the token first, so only the watcher reads from it.
+	blocking = true;
+	return fd;
+}
+
+bool JobServer::connect(const String &auth) {
+	if (auth.compare(0, 5, "fifo:") == 0) {
+		String path = auth.substr(5);
+		// Note: Opening it for both reading and writing avoids blocking until there is a writer.
+		readFd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		writeFd = readFd;
+		return readFd >= 0;
+	}
+
+	nat comma = auth.find(',');
+	if (comma == String::npos)
+		return false;
+
+	int r = to<int>(auth.substr(0, comma), -1);
+	int w = to<int>(auth.substr(comma + 1), -1);
+	if (!validFd(r) || !validFd(w))
+		return false;
+
+	readFd = prepareRead(r, blocking);
+	writeFd = w;
+	return true;
+}
+
+// Create a temporary directory for the fifo.
+static String tempDir() {
+	const char *tmp = getenv("TMPDIR");
+	String pattern = tmp ? tmp : "/tmp";
+	pattern += "/mymake.XXXXXX";
+
+	vector<char> buffer(pattern.begin(), pattern.end());
+	buffer.push_back(0);
+	if (!mkdtemp(&buffer[0]))
+		return "";
+
+	return &buffer[0];
+}
+
+bool JobServer::create(nat slots, const String &mode, String &auth) {
+	if (mode == "fifo") {
+		String dir = tempDir();
+		if (dir.empty())
+			return false;
+
+		fifo = dir + "/jobserver";
+		if (mkfifo(fifo.c_str(), 0600)) {
+			rmdir(dir.c_str());
+			fifo = "";
+			return false;
+		}
+
+		readFd = open(fifo.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		writeFd = readFd;
+		auth = "fifo:" + fifo;
+	} else {
+		// Note: Not O_CLOEXEC, our children shall inherit these.
+		int fds[2];
+		if (pipe(fds))
+			return false;
+
+		sharedRead = fds[0];
+		sharedWrite = fds[1];
+		readFd = prepareRead(sharedRead, blocking);
+		writeFd = sharedWrite;
+		auth = toS(sharedRead) + "," + toS(sharedWrite);
+	}
+
+	if (readFd < 0)
+		return false;
+
+	// We own one slot implicitly.
+	String tokens(slots - 1, tokenChar);
+	return writePipe(writeFd, tokens.c_str(), tokens.size());
+}
+
+// Read a token from 'fd'.
+static bool readToken(int fd, char &token) {
+	while (true) {
+		ssize_t r = read(fd, &token, 1);
+		if (r == 1)
+			return true;
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		// EAGAIN, or some other error.
+		return false;
+	}
+}
+
+bool JobServer::takeToken(char &token) {
+	// Reading from a blocking description may block while our caller holds locks.
+	if (blocking)
+		return false;
+
+	return readToken(readFd, token);
+}
+
+bool JobServer::waitToken(char &token) {
+	pollfd p = { readFd, POLLIN, 0 };
+	while (poll(&p, 1, -1) < 0 && errno == EINTR)
+		;
+
+	// We can not read from a blocking description in 'takeToken', so read the token here. This
+	// blocks if someone else takes the token first, which is fine here.
+	if (blocking)
+		return readToken(readFd, token);
+
+	return false;
+}
+
+void JobServer::putToken(char token) {
+	writePipe(writeFd, &token, 1);
+}
+
+void JobServer::closeMe() {
+	// The watcher may still be waiting for the jobserver, and returns the token it gets. We are
+	// about to exit, so leave the file descriptors open for it.
+	if (!watching) {
+		if (readFd >= 0 && readFd != sharedRead)
+			close(readFd);
+		if (sharedRead >= 0)
+			close(sharedRead);
+		if (sharedWrite >= 0)
+			close(sharedWrite);
+		// Note: We did not open 'writeFd' ourselves unless it is one of the above.
+		readFd = writeFd = sharedRead = sharedWrite = -1;
+		blocking = false;
+	}
+
+	if (!fifo.empty()) {
+		unlink(fifo.c_str());
+		rmdir(fifo.substr(0, fifo.rfind('/')).c_str());
+		fifo = "";
+	}
+}
+
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+#include "env.h"
+#include "sync.h"
+
+/**
+ * Support for the GNU make jobserver protocol.
+ *
+ * A jobserver is a pipe (or a named fifo, or a named semaphore on Windows) that contains one token
+ * for each free job slot. Each participating process owns one implicit slot, and needs to acquire
+ * a token from the jobserver before it starts any additional jobs. The token is returned when the
+ * job terminates.
+ *
+ * If mymake is started from make (or from another instance of mymake) with a jobserver in
+ * MAKEFLAGS, we become a client of that jobserver. Otherwise, we create a jobserver of our own and
+ * pass it to our children through MAKEFLAGS, so that nested builds share the same job slots.
+ *
+ * Tokens are acquired without blocking, since the caller usually holds locks that other threads
+ * need. When no token is available, a watcher thread waits for the jobserver instead, and tells the
+ * caller when it is worth trying again.
+ */
+class JobServer : NoCopy {
+public:
+	// Clean up.
+	~JobServer();
+
+	// Set up the jobserver. If a jobserver is present in MAKEFLAGS, connect to that. Otherwise,
+	// create one with 'slots' slots, and add it to 'env' so that our children use it. 'mode' is
+	// the value of the 'jobserver' option: "no" disables the jobserver, "fifo" creates a named
+	// fifo rather than a pipe on UNIX.
+	static void init(nat slots, const String &mode, Env &env);
+
+	// Try to acquire a token. Returns false if no token is available at the moment. In that case,
+	// 'onAvailable' is called from another thread when a token may have become available. Always
+	// succeeds when no jobserver is in use.
+	static bool acquire(void (*onAvailable)());
+
+	// Return a token previously acquired by 'acquire'.
+	static void release();
+
+	// Remove any files created by the jobserver.
+	static void shutdown();
+
+private:
+	// Disallow creation.
+	JobServer();
+
+	// Our global instance.
+	static JobServer me;
+
+	// Connected to a jobserver? Only changed while holding 'tokenLock' after 'init'.
+	bool active;
+
+	// Token bytes we have acquired, so that we can return the same ones.
+	String heldTokens;
+
+	// Tokens received by the watcher that have not been handed out yet.
+	String spareTokens;
+
+	// Does anyone wait for a token? Signals the watcher through 'wantedCond'.
+	bool wanted;
+	CondVar wantedCond;
+
+	// Function to call when a token may be available.
+	void (*onAvailable)();
+
+	// Is the watcher thread started?
+	bool watching;
+
+	// Lock for the members above.
+	Lock tokenLock;
+
+#ifdef WINDOWS
+	// Named semaphore.
+	HANDLE sema;
+#else
+	// File descriptors used for reading and writing tokens.
+	int readFd, writeFd;
+
+	// File descriptors shared with children (if we created the jobserver using a pipe).
+	int sharedRead, sharedWrite;
+
+	// Is 'readFd' blocking? If so, we need to poll it before reading.
+	bool blocking;
+
+	// Named fifo, if we created one.
+	String fifo;
+#endif
+
+	// Connect to an existing jobserver, given the value of --jobserver-auth.
+	bool connect(const String &auth);
+
+	// Create a jobserver.
+	bool create(nat slots, const String &mode, String &auth);
+
+	// Try to take a token without blocking.
+	bool takeToken(char &token);
+
+	// Wait until a token may be available. Returns true if we took it while waiting.
+	bool waitToken(char &token);
+
+	// Return a token to the jobserver.
+	void putToken(char token);
+
+	// Close the jobserver.
+	void closeMe();
+
+	// Main function of the watcher thread.
+	void watch();
+
+	// Helpers.
+	bool acquireMe(void (*onAvailable)());
+	void releaseMe();
+	void shutdownMe();
+};
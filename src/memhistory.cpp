@@ -0,0 +1,64 @@
+#include "std.h"
+#include "memhistory.h"
+#include "sync.h"
+
+// Same separator as in 'Commands'. The key is a path.
+static const char SEPARATOR = ':';
+
+MemoryHistory::MemoryHistory() {}
+
+nat64 MemoryHistory::predict(const String &key) const {
+	Lock::Guard z(lock);
+
+	FlatMap<String, nat64>::const_iterator found = peaks.find(key);
+	if (found == peaks.end())
+		return 0;
+	return found->second;
+}
+
+void MemoryHistory::record(const String &key, nat64 peak, bool complete) {
+	// Not measured.
+	if (peak == 0)
+		return;
+
+	Lock::Guard z(lock);
+
+	nat64 &to = peaks[key];
+	if (complete)
+		to = peak;
+	else
+		to = max(to, peak);
+}
+
+void MemoryHistory::load(const Path &file) {
+	Lock::Guard z(lock);
+
+	ifstream src(toS(file).c_str());
+
+	String line;
+	while (getline(src, line)) {
+		size_t pos = line.rfind(SEPARATOR);
+		if (pos == String::npos)
+			continue;
+
+		// Stored in KiB.
+		peaks[line.substr(0, pos)] = to<nat64>(line.substr(pos + 1)) * 1024;
+	}
+}
+
+void MemoryHistory::save(const Path &file) const {
+	Lock::Guard z(lock);
+
+	if (peaks.empty())
+		return;
+
+	ofstream dst(toS(file).c_str());
+
+	// Keep ordering stable in the file.
+	vector<std::pair<String, nat64>> ordered(peaks.begin(), peaks.end());
+	std::sort(ordered.begin(), ordered.end());
+
+	for (size_t i = 0; i < ordered.size(); i++) {
+		dst << ordered[i].first << SEPARATOR << (ordered[i].second / 1024) << '\n';
+	}
+}
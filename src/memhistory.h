@@ -0,0 +1,36 @@
+#pragma once
+#include "path.h"
+#include "hash.h"
+
+/**
+ * Peak memory usage of the commands executed for a target, used to predict the memory usage of
+ * future executions of the same commands.
+ *
+ * Note: Since this class is used in callbacks, it is thread-safe.
+ */
+class MemoryHistory {
+public:
+	// Create.
+	MemoryHistory();
+
+	// Load data.
+	void load(const Path &file);
+
+	// Save data.
+	void save(const Path &file) const;
+
+	// Get the expected peak memory usage of the command identified by 'key', in bytes. Returns zero
+	// if unknown.
+	nat64 predict(const String &key) const;
+
+	// Record the peak memory usage of the command identified by 'key'. If 'complete' is false, the
+	// command did not run to completion, and 'peak' is only a lower bound.
+	void record(const String &key, nat64 peak, bool complete);
+
+private:
+	// Lock for 'peaks'.
+	mutable Lock lock;
+
+	// Peak memory usage for each command, in bytes.
+	FlatMap<String, nat64> peaks;
+};
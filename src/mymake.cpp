@@ -5,6 +5,11 @@
 #include "projectcompile.h"
 #include "process.h"
 #include "outputmgr.h"
+#include "outputblock.h"
+#include "jobserver.h"
+#include "worker.h"
+#include "buildstats.h"
+#include "history.h"
 
 // Load the global configuration file if it exists.
 void loadGlobalConfig(const CmdLine &cmdline, MakeConfig &config) {
@@ -17,6 +22,84 @@ void loadGlobalConfig(const CmdLine &cmdline, MakeConfig &config) {
 	}
 }
 
+// Get the path of 'name' in the build directory of the project (or target).
+Path buildFile(const Config &params, const String &name) {
+	Path root(params.getStr("projectRoot"));
+	return Path(params.getVars("buildDir")).makeAbsolute(root) + Path(name);
+}
+
+// Get the file containing the shared secret for build workers, if any.
+Path secretFile(const Config &params) {
+	String file = params.getStr("workerSecret");
+	if (file.empty())
+		return Path();
+	return Path(file).makeAbsolute();
+}
+
+// Set up the global process and memory limits and the jobserver. Adds the jobserver to the environment in
+// 'params' if needed.
+void setupJobs(Config &params) {
+	nat threads = to<nat>(params.getStr("maxThreads", "1"));
+	if (params.getBool("adaptiveThreads"))
+		ProcGroup::setAdaptive(to<nat>(params.getStr("minThreads", "1")), threads);
+	else
+		ProcGroup::setLimit(threads);
+
+	String memory = params.getStr("maxMemory", "auto");
+	if (memory == "no")
+		ProcGroup::setMemoryLimit(false, 0);
+	else if (memory == "auto")
+		ProcGroup::setMemoryLimit(true, 0);
+	else
+		ProcGroup::setMemoryLimit(true, to<nat64>(memory) << 20);
+
+	FileCache::setPrefetchThreads(to<nat>(params.getStr("prefetchThreads", "8")));
+	Arena::setTeardown(params.getBool("freeMemory"));
+
+	// Fail-fast mode needs grouped output, so that the output of the failure is not mixed with
+	// output from the processes that are terminated.
+	bool failFast = params.getBool("failFast");
+	ProcGroup::setFailFast(failFast);
+	OutputBlock::setGrouped(failFast || params.getBool("groupOutput"));
+	if (params.getBool("buildLog"))
+		OutputBlock::setLog(buildFile(params, "build.log"));
+
+	vector<String> workers = params.getArray("workers");
+	if (!workers.empty())
+		setWorkerSecret(secretFile(params));
+	for (nat i = 0; i < workers.size(); i++) {
+		nat slots = 0;
+		if (queryWorker(workers[i], slots))
+			ProcGroup::addWorker(workers[i], slots);
+	}
+
+	JobServer::init(threads, params.getStr("jobserver"), params.env);
+}
+
+// Collect statistics if they are needed for --stats or the build history.
+void setupStats(const CmdLine &cmdline, const Config &params) {
+	BuildStats::setEnabled(cmdline.stats || params.getBool("buildHistory", true));
+}
+
+// Show the build history.
+int showHistory(const Config &params) {
+	BuildHistory::show(buildFile(params, "history"), to<nat>(params.getStr("regressionThreshold", "50")));
+	return 0;
+}
+
+// Print build statistics if requested, and add the build to the history. 'start' is the time the
+// build started, 'find' the time it took to find dependencies.
+void reportStats(const CmdLine &cmdline, const Config &params, bool ok, const Timestamp &start, const Timespan &find, const FileCache &files) {
+	Timespan total = Timestamp() - start;
+	if (cmdline.stats)
+		BuildStats::report(buildFile(params, "stats.json"), total, to<nat>(params.getStr("maxThreads", "1")), files);
+
+	// Note: We don't create the build directory only to save the history.
+	Path history = buildFile(params, "history");
+	if (params.getBool("buildHistory", true) && history.parent().exists())
+		BuildHistory::append(history, ok, find, total);
+}
+
 // Compile a stand-alone .mymake-file.
 int compileTarget(const Path &wd, const CmdLine &cmdline) {
 	Timestamp start;
@@ -46,8 +129,12 @@ int compileTarget(const Path &wd, const CmdLine &cmdline) {
 	params.env = Env::update(Env::current(), params);
 	DEBUG("Environment variables for compilation: " << params.env, DEBUG);
 
+	if (cmdline.history)
+		return showHistory(params);
+
 	// Set max # threads.
-	ProcGroup::setLimit(to<nat>(params.getStr("maxThreads", "1")));
+	setupJobs(params);
+	setupStats(cmdline, params);
 
 	compile::Target c(wd, params);
 	if (cmdline.clean) {
@@ -68,10 +155,12 @@ int compileTarget(const Path &wd, const CmdLine &cmdline) {
 		if (cmdline.times) {
 			PLN("Compilation time: " << (compEnd - compStart));
 			PLN("Total time: " << (compEnd - start));
+			PLN("File system: " << c.files());
 		}
 	}
 
 	c.save();
+	reportStats(cmdline, params, ok, start, depEnd - depStart, c.files());
 
 	if (!ok) {
 		PLN("Compilation failed!");
@@ -81,6 +170,7 @@ int compileTarget(const Path &wd, const CmdLine &cmdline) {
 	DEBUG("Compilation successful!", NORMAL);
 
 	OutputMgr::shutdown();
+	JobServer::shutdown();
 
 	return c.execute(cmdline.params);
 }
@@ -105,8 +195,12 @@ int compileProject(const Path &wd, const Path &projectFile, const CmdLine &cmdli
 
 	DEBUG("Configuration options: " << params, VERBOSE);
 
+	if (cmdline.history)
+		return showHistory(params);
+
 	// Set max # threads.
-	ProcGroup::setLimit(to<nat>(params.getStr("maxThreads", "1")));
+	setupJobs(params);
+	setupStats(cmdline, params);
 
 	compile::Project c(wd, cmdline.names, config, params, cmdline.times);
 	DEBUG("-- Finding dependencies --", NORMAL);
@@ -119,6 +213,7 @@ int compileProject(const Path &wd, const Path &projectFile, const CmdLine &cmdli
 
 	if (!ok) {
 		c.save();
+		reportStats(cmdline, params, false, start, depEnd - depStart, c.files());
 		PLN("Compilation failed!");
 		return 1;
 	}
@@ -132,6 +227,7 @@ int compileProject(const Path &wd, const Path &projectFile, const CmdLine &cmdli
 	ok = c.compile();
 	Timestamp compEnd;
 	c.save();
+	reportStats(cmdline, params, ok, start, depEnd - depStart, c.files());
 
 	if (!ok) {
 		PLN("Compilation failed!");
@@ -141,10 +237,12 @@ int compileProject(const Path &wd, const Path &projectFile, const CmdLine &cmdli
 	if (cmdline.times) {
 		PLN("Compilation time: " << (compEnd - compStart));
 		PLN("Total time: " << (compEnd - start));
+		PLN("File system: " << c.files());
 	}
 	DEBUG("-- Compilation successful! --", NORMAL);
 
 	OutputMgr::shutdown();
+	JobServer::shutdown();
 
 	if (params.getBool("execute")) {
 		return c.execute(cmdline.params);
@@ -153,8 +251,25 @@ int compileProject(const Path &wd, const Path &projectFile, const CmdLine &cmdli
 	return 0;
 }
 
+// Run as a build worker.
+int runWorker(const CmdLine &cmdline) {
+	MakeConfig config;
+	loadGlobalConfig(cmdline, config);
+
+	Config params;
+	config.apply(cmdline.names, params);
+	cmdline.apply(config.options(), params);
+
+	setWorkerSecret(secretFile(params));
+	return runWorker(cmdline.worker, to<nat>(params.getStr("maxThreads", "1")));
+}
+
 // Main entry-point for mymake.
 int real_main(int argc, const char *argv[]) {
+	// Used internally by ProcGroup to execute commands on build workers.
+	if (argc >= 2 && String(argv[1]) == "--submit")
+		return submitMain(vector<String>(argv + 2, argv + argc));
+
 	CmdLine cmdline(vector<String>(argv, argv + argc));
 
 #ifdef WINDOWS
@@ -178,6 +293,9 @@ int real_main(int argc, const char *argv[]) {
 		return 0;
 	}
 
+	if (!cmdline.worker.empty())
+		return runWorker(cmdline);
+
 	// Find a config file and cd there.
 	Path newPath = findConfig();
 	DEBUG("Working directory: " << newPath, INFO);
@@ -0,0 +1,263 @@
+#include "std.h"
+#include "outputblock.h"
+
+// Output more than this per stream is moved to a temporary file while the process is running.
+static const nat maxInMemory = 256 * 1024;
+
+// Write blocks rather than lines?
+static bool groupOutput = false;
+
+// Log file, if any.
+static Path logFile;
+static bool logEnabled = false;
+
+// Lock for the log.
+static Lock logLock;
+
+void OutputBlock::setGrouped(bool grouped) {
+	groupOutput = grouped;
+}
+
+bool OutputBlock::grouped() {
+	return groupOutput;
+}
+
+void OutputBlock::setLog(const Path &file) {
+	Lock::Guard z(logLock);
+	logFile = file;
+	logEnabled = true;
+}
+
+bool OutputBlock::enabled() {
+	return groupOutput || logEnabled;
+}
+
+#ifdef WINDOWS
+
+static HANDLE logHandle = INVALID_HANDLE_VALUE;
+
+// Open the log. Assumes 'logLock' is held.
+static bool openLog() {
+	if (logHandle != INVALID_HANDLE_VALUE)
+		return true;
+
+	logFile.parent().createDir();
+	logHandle = CreateFile(toS(logFile).c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	return logHandle != INVALID_HANDLE_VALUE;
+}
+
+// Write 'count' strings to the log. Assumes 'logLock' is held.
+static void writeLog(const String *parts, nat count) {
+	String all;
+	for (nat i = 0; i < count; i++)
+		all += parts[i];
+
+	DWORD written;
+	WriteFile(logHandle, all.c_str(), DWORD(all.size()), &written, NULL);
+}
+
+#else
+
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+static int logFd = -1;
+
+// Open the log. Assumes 'logLock' is held.
+static bool openLog() {
+	if (logFd >= 0)
+		return true;
+
+	logFile.parent().createDir();
+	logFd = open(toS(logFile).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0666);
+	return logFd >= 0;
+}
+
+// Write 'count' strings to the log. Assumes 'logLock' is held.
+static void writeLog(const String *parts, nat count) {
+	vector<iovec> iov;
+	for (nat i = 0; i < count; i++) {
+		if (parts[i].empty())
+			continue;
+		iovec v = { (void *)parts[i].c_str(), parts[i].size() };
+		iov.push_back(v);
+	}
+
+	// Usually, everything is written by the first call. If not (e.g. the disk is full), we
+	// continue where it stopped.
+	nat at = 0;
+	while (at < iov.size()) {
+		ssize_t r = writev(logFd, &iov[at], int(min(iov.size() - at, nat(IOV_MAX))));
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		size_t done = size_t(r);
+		while (at < iov.size() && done >= iov[at].iov_len)
+			done -= iov[at++].iov_len;
+		if (at < iov.size()) {
+			iov[at].iov_base = (char *)iov[at].iov_base + done;
+			iov[at].iov_len -= done;
+		}
+	}
+}
+
+#endif
+
+
+OutputBlock::Stream::Stream() : spill(null), size(0) {}
+
+OutputBlock::Stream::~Stream() {
+	if (spill)
+		fclose(spill);
+}
+
+void OutputBlock::Stream::add(const char *src, nat count) {
+	size += count;
+
+	if (!spill && data.size() + count > maxInMemory) {
+		spill = tmpfile();
+		if (spill) {
+			fwrite(data.c_str(), 1, data.size(), spill);
+			data = String();
+		}
+	}
+
+	if (spill)
+		fwrite(src, 1, count, spill);
+	else
+		data.append(src, count);
+}
+
+void OutputBlock::Stream::take(String &to) {
+	if (spill) {
+		to.resize(size);
+		rewind(spill);
+		nat read = fread(&to[0], 1, size, spill);
+		to.resize(read);
+		fclose(spill);
+		spill = null;
+	} else {
+		to.swap(data);
+	}
+
+	data = String();
+	size = 0;
+}
+
+
+OutputBlock::OutputBlock(OutputState *state, const String &command) :
+	state(state->ref()), command(command), result(0), hasResult(false), written(false), quiet(false), refs(1) {}
+
+OutputBlock::~OutputBlock() {
+	state->unref();
+}
+
+OutputBlock *OutputBlock::ref() {
+	Lock::Guard z(lock);
+	refs++;
+	return this;
+}
+
+void OutputBlock::unref() {
+	bool destroy = false;
+	{
+		Lock::Guard z(lock);
+		if (--refs == 0) {
+			destroy = true;
+			if (!written || !out.empty() || !err.empty())
+				write();
+		}
+	}
+
+	// Note: Has to be done *after* releasing the lock!
+	if (destroy)
+		delete this;
+}
+
+void OutputBlock::add(bool errorStream, const char *data, nat size) {
+	Lock::Guard z(lock);
+	if (errorStream)
+		err.add(data, size);
+	else
+		out.add(data, size);
+}
+
+void OutputBlock::discard() {
+	Lock::Guard z(lock);
+	quiet = true;
+}
+
+void OutputBlock::exited(int result) {
+	Lock::Guard z(lock);
+	this->result = result;
+	hasResult = true;
+	write();
+}
+
+// Write 'text' to 'to' line by line, adding prefixes from 'state'. Assumes 'outputLock' is held.
+static void writeLines(ostream &to, OutputState *state, const String &text) {
+	nat start = 0;
+	while (start < text.size()) {
+		nat end = text.find('\n', start);
+		if (end == String::npos)
+			end = text.size();
+
+		state->output(to);
+		to.write(text.c_str() + start, end - start);
+		to << '\n';
+		start = end + 1;
+	}
+	to.flush();
+}
+
+// Make sure 'text' ends with a newline, unless it is empty.
+static void endLine(String &text) {
+	if (!text.empty() && text[text.size() - 1] != '\n')
+		text += '\n';
+}
+
+void OutputBlock::write() {
+	String outText, errText;
+	out.take(outText);
+	err.take(errText);
+
+	if (groupOutput && !quiet && (!outText.empty() || !errText.empty())) {
+		Lock::Guard z(outputLock);
+		writeLines(std::cout, state, outText);
+		writeLines(std::cerr, state, errText);
+	}
+
+	if (logEnabled) {
+		std::ostringstream header;
+		if (written) {
+			header << "--- (continued) " << command << '\n';
+		} else {
+			header << "--- " << command << '\n';
+			header << "--- ";
+			if (!hasResult)
+				header << "result unknown";
+			else if (result < 0)
+				header << "killed by signal " << -result;
+			else
+				header << "exit code " << result;
+			header << ", " << (Timestamp() - started) << '\n';
+		}
+
+		String parts[3];
+		parts[0] = header.str();
+		parts[1].swap(outText);
+		parts[2].swap(errText);
+		endLine(parts[1]);
+		endLine(parts[2]);
+
+		Lock::Guard z(logLock);
+		if (openLog())
+			writeLog(parts, 3);
+	}
+
+	written = true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "path.h"
+#include "timestamp.h"
+#include <cstdio>
+
+/**
+ * Output from one process, collected so that it can be written as one block instead of line by
+ * line. This keeps multi-line diagnostics from different processes apart. Blocks are also written
+ * to the build log, if enabled.
+ *
+ * The block is written when the process has terminated (see 'exited'). Any output that arrives
+ * after that (e.g. from background processes) is written when the last reference is released.
+ *
+ * Reference counted, like OutputState. Thread safe.
+ */
+class OutputBlock : NoCopy {
+public:
+	// Create, with one reference. 'state' is used to add prefixes, 'command' is written to the log.
+	OutputBlock(OutputState *state, const String &command);
+
+	// Add a reference. Returns a pointer to itself for ease of use.
+	OutputBlock *ref();
+
+	// Release a reference.
+	void unref();
+
+	// Add output from the process.
+	void add(bool errorStream, const char *data, nat size);
+
+	// The process terminated with 'result'. Writes the block.
+	void exited(int result);
+
+	// Only write the output to the log, not to stdout.
+	void discard();
+
+	// Write output as blocks rather than line by line?
+	static void setGrouped(bool grouped);
+	static bool grouped();
+
+	// Write blocks to the log file 'file'. The file is replaced the first time something is written.
+	static void setLog(const Path &file);
+
+	// Do we need to collect blocks at all?
+	static bool enabled();
+
+private:
+	// Destroy. Use 'unref'.
+	~OutputBlock();
+
+	/**
+	 * Output to one stream. Large outputs are moved to a temporary file.
+	 */
+	class Stream : NoCopy {
+	public:
+		Stream();
+		~Stream();
+
+		// Append data.
+		void add(const char *data, nat size);
+
+		// Any data?
+		inline bool empty() const { return size == 0; }
+
+		// Take all data, leaving the stream empty.
+		void take(String &to);
+
+	private:
+		// Data in memory.
+		String data;
+
+		// Temporary file, if we have moved data there.
+		FILE *spill;
+
+		// Total size.
+		nat size;
+	};
+
+	// Output state. Owns a reference.
+	OutputState *state;
+
+	// Command executed.
+	String command;
+
+	// When the process was started (approximately).
+	Timestamp started;
+
+	// Output so far.
+	Stream out, err;
+
+	// Result of the process, if 'hasResult'.
+	int result;
+	bool hasResult;
+
+	// Has the block been written once?
+	bool written;
+
+	// Only write to the log?
+	bool quiet;
+
+	// Reference count.
+	nat refs;
+
+	// Lock for the contents.
+	Lock lock;
+
+	// Write the contents to the output (if grouped) and to the log. Assumes 'lock' is held.
+	void write();
+};
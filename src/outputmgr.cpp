@@ -1,7 +1,11 @@
 #include "std.h"
 #include "outputmgr.h"
+#include "outputblock.h"
+#include <cstring>
 
-OutputMgr::OutputMgr() {
+HandleWatch::~HandleWatch() {}
+
+OutputMgr::OutputMgr() : pipeSet(null), edits(null) {
 	createPipe(selfRead, selfWrite, false);
 	thread.start(&OutputMgr::threadMain, *this);
 	running = true;
@@ -13,6 +17,9 @@ OutputMgr::~OutputMgr() {
 }
 
 void OutputMgr::shutdownMe() {
+	// Don't accept any more handles to watch, nobody would wait for them.
+	running = false;
+
 	// Notify exit.
 	writePipe(selfWrite, "E", 1);
 	thread.join();
@@ -22,57 +29,95 @@ void OutputMgr::shutdownMe() {
 		delete i->second;
 	}
 
-	while (!toAdd.empty()) {
-		delete toAdd.front();
-		toAdd.pop();
+	for (WatchMap::iterator i = watches.begin(), end = watches.end(); i != end; ++i) {
+		closePipe(i->first);
+		delete i->second->callback;
+		delete i->second;
 	}
 
-	running = false;
-}
-
-void OutputMgr::addPipe(Pipe pipe, OutputState *state, nat skip, bool errorStream) {
-	Sema ack(0);
-
-	{
-		Lock::Guard z(editsLock);
-		PipeData *data = new PipeData(pipe, state, skip, errorStream);
-		toAdd.push(data);
-		wake.push(&ack);
+	Edit *edit = takeEdits();
+	while (edit) {
+		Edit *next = edit->next;
+		delete edit->add;
+		if (edit->watch) {
+			closePipe(edit->pipe);
+			delete edit->watch->callback;
+			delete edit->watch;
+		}
+		delete edit;
+		edit = next;
 	}
+}
 
-	// Notify and wait.
-	writePipe(selfWrite, "U", 1);
-	ack.down();
+void OutputMgr::addPipe(Pipe pipe, OutputState *state, nat skip, bool errorStream, OutputBlock *block) {
+	Edit *edit = new Edit();
+	edit->pipe = pipe;
+	edit->add = new PipeData(pipe, state, skip, errorStream, block);
+	edit->watch = null;
+	submit(edit);
 }
 
 void OutputMgr::removePipe(Pipe pipe) {
-	Sema ack(0);
+	Edit *edit = new Edit();
+	edit->pipe = pipe;
+	edit->add = null;
+	edit->watch = null;
+	submit(edit);
+}
 
-	{
-		Lock::Guard z(editsLock);
-		RemoveData r = { pipe };
-		toRemove.push(r);
-		wake.push(&ack);
+bool OutputMgr::watchHandle(Pipe handle, HandleWatch *callback, Pipe out, Pipe err) {
+	if (!running)
+		return false;
+
+	Watch *watch = new Watch();
+	watch->callback = callback;
+	watch->out = out;
+	watch->err = err;
+
+	Edit *edit = new Edit();
+	edit->pipe = handle;
+	edit->add = null;
+	edit->watch = watch;
+	submit(edit);
+	return true;
+}
+
+void OutputMgr::submit(Edit *edit) {
+	while (true) {
+		void *head = edits;
+		edit->next = (Edit *)head;
+		if (atomicCAS(edits, head, edit) == head)
+			break;
 	}
 
-	// Notify and wait.
-	writePipe(selfWrite, "U", 1);
-	ack.down();
+	// Only notify our thread if the queue was empty. Otherwise, the edit before us has notified it
+	// already (or will do so shortly), and it takes all edits at once.
+	if (!edit->next)
+		writePipe(selfWrite, "U", 1);
+}
+
+OutputMgr::Edit *OutputMgr::takeEdits() {
+	Edit *edit = (Edit *)atomicSwap(edits, null);
+
+	// Reverse the list, so that edits are carried out in order. This is important, since pipe
+	// handles may be reused after they have been removed.
+	Edit *result = null;
+	while (edit) {
+		Edit *next = edit->next;
+		edit->next = result;
+		result = edit;
+		edit = next;
+	}
+	return result;
 }
 
 void OutputMgr::threadMain() {
 	bool exit = false;
-	PipeSet *pipeSet = createPipeSet(PipeData::bufferSize);
+	pipeSet = createPipeSet(readSize);
 	addPipeSet(pipeSet, selfRead);
 
-	// Remember which threads have terminated recently.
-	set<Pipe> terminated;
-
-	// Remember which pipes shall be closed soon.
-	set<Pipe> terminate;
-
 	// Output buffer.
-	char buffer[PipeData::bufferSize];
+	char buffer[readSize];
 	nat written;
 	Pipe from;
 
@@ -81,82 +126,135 @@ void OutputMgr::threadMain() {
 		readPipeSet(pipeSet, buffer, written, from);
 
 		PipeMap::iterator it = pipes.find(from);
-		if (it == pipes.end()) {
-			// From selfRead.
-			bool update = false;
-			for (nat i = 0; i < written; i++) {
-				if (buffer[i] == 'E') {
-					exit = true;
-				} else if (buffer[i] == 'U') {
-					update = true;
-				}
-			}
-
-			if (update) {
-				Lock::Guard z(editsLock);
-
-				while (!toAdd.empty()) {
-					PipeData *i = toAdd.front();
-					toAdd.pop();
-					pipes.insert(make_pair(i->pipe, i));
-					addPipeSet(pipeSet, i->pipe);
-				}
-
-				while (!toRemove.empty()) {
-					RemoveData e = toRemove.front();
-					toRemove.pop();
-
-					if (terminated.count(e.pipe)) {
-						// Already terminated.
-						terminated.erase(e.pipe);
-						// Close the pipe. Now it is safe!
-						PipeMap::iterator i = pipes.find(e.pipe);
-						if (i == pipes.end())
-							WARNING(L"The pipe " << e.pipe << L" was removed too early!");
-						delete i->second;
-						pipes.erase(i);
-					} else {
-						// Wait for termination.
-						terminate.insert(e.pipe);
-					}
-				}
-
-				while (!wake.empty()) {
-					wake.front()->up();
-					wake.pop();
-				}
-			}
-		} else if (written != 0) {
-			// We got some data!
-			it->second->add(buffer, written);
-		} else {
-			// End of stream!
-			removePipeSet(pipeSet, from);
-
-			// Someone waiting for us?
-			set<Pipe>::iterator i = terminate.find(from);
-			if (i != terminate.end()) {
-				// Yes, then we can remove it already.
-				terminate.erase(i);
-
-				// Remove the pipe.
-				delete it->second;
-				pipes.erase(it);
+		if (it != pipes.end()) {
+			if (written != 0) {
+				// We got some data!
+				it->second->add(buffer, written);
 			} else {
-				// No, but someone will come eventually!
-				terminated.insert(from);
-				// Note: We're not closing the pipe until someone has waited on the pipe, as the
-				// pipe's identifier could be reused by the operating system, which causes us to
-				// deadlock.
+				// End of stream!
+				closed(it);
 			}
+			continue;
+		}
+
+		WatchMap::iterator w = watches.find(from);
+		if (w != watches.end()) {
+			signaled(w, buffer);
+			continue;
+		}
+
+		// From selfRead.
+		for (nat i = 0; i < written; i++) {
+			if (buffer[i] == 'E')
+				exit = true;
+		}
+
+		// Note: We might find edits here even if we did not see a 'U', and the queue might be
+		// empty even if we did. That only means that we will see a 'U' without any edits later.
+		Edit *edit = takeEdits();
+		while (edit) {
+			Edit *next = edit->next;
+			apply(edit);
+			delete edit;
+			edit = next;
 		}
 	}
 
 	destroyPipeSet(pipeSet);
+	pipeSet = null;
+}
+
+void OutputMgr::apply(Edit *edit) {
+	if (edit->add) {
+		pipes.insert(make_pair(edit->pipe, edit->add));
+		addPipeSet(pipeSet, edit->pipe);
+	} else if (edit->watch) {
+		watches.insert(make_pair(edit->pipe, edit->watch));
+		addPipeSet(pipeSet, edit->pipe);
+	} else if (terminated.count(edit->pipe)) {
+		// Already terminated.
+		terminated.erase(edit->pipe);
+		// Close the pipe. Now it is safe!
+		PipeMap::iterator i = pipes.find(edit->pipe);
+		if (i == pipes.end()) {
+			WARNING(L"The pipe " << edit->pipe << L" was removed too early!");
+		} else {
+			delete i->second;
+			pipes.erase(i);
+		}
+	} else {
+		// Wait for termination.
+		terminate.insert(edit->pipe);
+	}
+}
+
+void OutputMgr::closed(PipeMap::iterator it) {
+	Pipe pipe = it->first;
+	removePipeSet(pipeSet, pipe);
+
+	// Someone waiting for us?
+	set<Pipe>::iterator i = terminate.find(pipe);
+	if (i != terminate.end()) {
+		// Yes, then we can remove it already.
+		terminate.erase(i);
+
+		// Remove the pipe.
+		delete it->second;
+		pipes.erase(it);
+	} else {
+		// No, but someone will come eventually!
+		terminated.insert(pipe);
+		// Note: We're not closing the pipe until someone has waited on the pipe, as the
+		// pipe's identifier could be reused by the operating system, which causes us to
+		// deadlock.
+	}
+}
+
+void OutputMgr::drain(Pipe pipe, char *buffer) {
+	if (pipe == noPipe || terminated.count(pipe))
+		return;
+
+	PipeMap::iterator it = pipes.find(pipe);
+	if (it == pipes.end())
+		return;
+
+	// Don't get stuck if someone keeps writing to the pipe (e.g. a background process started by
+	// the process that terminated). The pipe does not hold more than this anyway.
+	for (nat i = 0; i < 64; i++) {
+		nat written;
+		if (!readPipe(pipe, buffer, readSize, written))
+			break;
+
+		if (written == 0) {
+			closed(it);
+			break;
+		}
+
+		it->second->add(buffer, written);
+	}
 }
 
-OutputMgr::PipeData::PipeData(Pipe pipe, OutputState *state, nat skip, bool errorStream) :
-	pipe(pipe), state(state->ref()), skipLines(skip), errorStream(errorStream), bufferCount(0) {}
+void OutputMgr::signaled(WatchMap::iterator w, char *buffer) {
+	Pipe handle = w->first;
+	Watch *watch = w->second;
+	watches.erase(w);
+
+	// Output the process produced before the handle was signaled is already in the pipes.
+	// Forward it first, so that whoever waits for the handle sees things in a sensible order.
+	drain(watch->out, buffer);
+	drain(watch->err, buffer);
+
+	removePipeSet(pipeSet, handle);
+	closePipe(handle);
+
+	watch->callback->signaled();
+	delete watch->callback;
+	delete watch;
+}
+
+OutputMgr::PipeData::PipeData(Pipe pipe, OutputState *state, nat skip, bool errorStream, OutputBlock *block) :
+	pipe(pipe), state(state->ref()), block(block ? block->ref() : null),
+	skipLines(skip), errorStream(errorStream), bufferCount(0) {}
 
 OutputMgr::PipeData::~PipeData() {
 	closePipe(pipe);
@@ -164,6 +262,8 @@ OutputMgr::PipeData::~PipeData() {
 	if (bufferCount > 0)
 		flush();
 
+	if (block)
+		block->unref();
 	state->unref();
 }
 
@@ -182,6 +282,18 @@ void OutputMgr::PipeData::add(const char *src, nat size) {
 			pos++;
 	}
 
+	if (block) {
+		block->add(errorStream, src + pos, size - pos);
+		if (OutputBlock::grouped())
+			return;
+	}
+
+	// No need to look at each line if there is no prefix.
+	if (state->prefix.empty()) {
+		forward(src + pos, size - pos);
+		return;
+	}
+
 	// Output.
 	for (nat i = pos; i < size; i++) {
 		if (src[i] == '\n') {
@@ -213,20 +325,63 @@ void OutputMgr::PipeData::flush() {
 	bufferCount = 0;
 }
 
+void OutputMgr::PipeData::forward(const char *src, nat size) {
+	nat end = size;
+	while (end > 0 && src[end - 1] != '\n')
+		end--;
+
+	if (end == 0 && bufferCount + size <= bufferSize) {
+		// Only part of a line. Wait for the rest.
+		memcpy(buffer + bufferCount, src, size);
+		bufferCount += size;
+		return;
+	}
+
+	// Write all complete lines. If the unfinished line does not fit in the buffer, we write that as well.
+	nat rest = size - end;
+	if (rest > bufferSize || end == 0) {
+		end = size;
+		rest = 0;
+	}
+
+	write(src, end);
+	memcpy(buffer, src + end, rest);
+	bufferCount = rest;
+}
+
+void OutputMgr::PipeData::write(const char *src, nat size) {
+	ostream &to = errorStream ? std::cerr : std::cout;
+
+	Lock::Guard z(outputLock);
+	// Write the banner, if any. We need to flush the stream since we bypass it.
+	state->output(to);
+	to.flush();
+
+	Pipe out = stdPipe(errorStream);
+	if (bufferCount > 0)
+		writePipe(out, buffer, bufferCount);
+	writePipe(out, src, size);
+	bufferCount = 0;
+}
+
 OutputMgr OutputMgr::me;
 
-void OutputMgr::add(Pipe pipe, OutputState *state, nat skip) {
-	me.addPipe(pipe, state, skip, false);
+void OutputMgr::add(Pipe pipe, OutputState *state, nat skip, OutputBlock *block) {
+	me.addPipe(pipe, state, skip, false, block);
 }
 
-void OutputMgr::addError(Pipe pipe, OutputState *state, nat skip) {
-	me.addPipe(pipe, state, skip, true);
+void OutputMgr::addError(Pipe pipe, OutputState *state, nat skip, OutputBlock *block) {
+	me.addPipe(pipe, state, skip, true, block);
 }
 
 void OutputMgr::remove(Pipe pipe) {
 	me.removePipe(pipe);
 }
 
+bool OutputMgr::watch(Pipe handle, HandleWatch *watch, Pipe out, Pipe err) {
+	return me.watchHandle(handle, watch, out, err);
+}
+
 void OutputMgr::shutdown() {
 	me.shutdownMe();
 }
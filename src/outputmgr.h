@@ -2,6 +2,21 @@
 #include "pipe.h"
 #include "thread.h"
 #include "sync.h"
+#include "atomic.h"
+
+class OutputBlock;
+
+/**
+ * Something waiting for a handle to be signaled (e.g. for a process to terminate). See
+ * OutputMgr::watch.
+ */
+class HandleWatch : NoCopy {
+public:
+	virtual ~HandleWatch();
+
+	// Called from the thread of the OutputMgr when the handle is signaled.
+	virtual void signaled() = 0;
+};
 
 /**
  * Output manager that multiplexes output from child processes line by line so that output does not
@@ -13,14 +28,21 @@ public:
 	// Clean up.
 	~OutputMgr();
 
-	// Add pipe. The pipe will be closed eventually.
-	static void add(Pipe pipe, OutputState *state, nat skipLines = 0);
-	static void addError(Pipe pipe, OutputState *state, nat skipLines = 0);
+	// Add pipe. The pipe will be closed eventually. If 'block' is set, output is also added to
+	// 'block', and if blocks are grouped (see OutputBlock::grouped), output is only added there.
+	static void add(Pipe pipe, OutputState *state, nat skipLines = 0, OutputBlock *block = null);
+	static void addError(Pipe pipe, OutputState *state, nat skipLines = 0, OutputBlock *block = null);
 
-	// Remove pipe.
-	// Not anymore: Waits until all output from the pipe is properly flushed (= the other end is closed).
+	// Remove pipe. Does not wait for the removal. The pipe is closed when all output from it has been
+	// forwarded (= the other end is closed).
 	static void remove(Pipe pipe);
 
+	// Watch 'handle', which becomes readable when it is signaled (e.g. a pidfd). When that happens,
+	// output that is already available in 'out' and 'err' is forwarded (they may be 'noPipe'),
+	// 'handle' is closed, and 'watch->signaled()' is called from our thread. Takes ownership of
+	// 'handle' and 'watch', unless we are not running. In that case, false is returned.
+	static bool watch(Pipe handle, HandleWatch *watch, Pipe out, Pipe err);
+
 	// Clean up all data in the manager, ensuring that all data is flushed.
 	static void shutdown();
 
@@ -34,6 +56,11 @@ private:
 	// Pipe to ourselves, used for communicating to the worker thread.
 	Pipe selfWrite, selfRead;
 
+	// Size of each read from the pipes.
+	enum {
+		readSize = 16 * 1024
+	};
+
 	// Data for one pipe.
 	struct PipeData {
 		// Pipe.
@@ -42,6 +69,9 @@ private:
 		// Output state. Owns a reference.
 		OutputState *state;
 
+		// Block to add output to, if any. Owns a reference.
+		OutputBlock *block;
+
 		// Lines to skip before outputting.
 		nat skipLines;
 
@@ -60,7 +90,7 @@ private:
 		nat bufferCount;
 
 		// Create.
-		inline PipeData(Pipe pipe, OutputState *state, nat skip, bool errorStream);
+		inline PipeData(Pipe pipe, OutputState *state, nat skip, bool errorStream, OutputBlock *block);
 
 		// Destroy.
 		~PipeData();
@@ -70,33 +100,80 @@ private:
 
 		// Flush buffer to stdout. Add newline.
 		void flush();
-	};
 
-	// Queued items for 'toRemove'.
-	struct RemoveData {
-		// Pipe to remove.
-		Pipe pipe;
+		// Forward data without a prefix. Whole lines are written directly to stdout or stderr,
+		// any unfinished line is kept in the buffer.
+		void forward(const char *src, nat size);
 
-		// Semaphore used to signal when deletion is complete.
-		// We don't wait for the pipes to close on removal, that hangs the system in some cases.
-		// The worst thing that happens is that some output is delayed a bit, we wont lose any
-		// output as we wait for all pipes to become empty before removing them at least.
-		// Sema *wake;
+		// Write the buffer followed by 'size' bytes from 'src' to stdout or stderr and empty the buffer.
+		void write(const char *src, nat size);
 	};
 
 	// All current pipes. Only used from our thread.
 	typedef map<Pipe, PipeData *> PipeMap;
 	PipeMap pipes;
 
-	// Queue for edits to 'pipes'.
-	queue<PipeData *> toAdd;
-	queue<RemoveData> toRemove;
+	// Pipes that have reached the end of stream, but have not been removed yet. Only used from our
+	// thread.
+	set<Pipe> terminated;
+
+	// Pipes that have been removed, but have not reached the end of stream yet. Only used from our
+	// thread.
+	set<Pipe> terminate;
+
+	// A watched handle.
+	struct Watch {
+		// Callback.
+		HandleWatch *callback;
+
+		// Pipes to forward output from before calling 'callback'.
+		Pipe out, err;
+	};
+
+	// All watched handles. Only used from our thread.
+	typedef map<Pipe, Watch *> WatchMap;
+	WatchMap watches;
+
+	// The set of pipes and handles we are waiting for. Only used from our thread.
+	PipeSet *pipeSet;
+
+	// An edit to 'pipes' or 'watches', submitted by some thread and carried out by our thread.
+	struct Edit {
+		// Next edit in the queue.
+		Edit *next;
+
+		// Pipe or handle to add or remove.
+		Pipe pipe;
+
+		// Data for the pipe to add, if any.
+		PipeData *add;
+
+		// Handle to watch, if any. If neither 'add' nor 'watch' is set, 'pipe' shall be removed.
+		Watch *watch;
+	};
+
+	// Submitted edits, most recent first. Edits are pushed without locks by any thread, and our
+	// thread takes the entire list at once. This means that adding and removing pipes does not have
+	// to wait for our thread.
+	void *volatile edits;
+
+	// Submit an edit.
+	void submit(Edit *edit);
+
+	// Take all submitted edits, in the order they were submitted.
+	Edit *takeEdits();
+
+	// Carry out an edit.
+	void apply(Edit *edit);
+
+	// Handle the end of stream of a pipe.
+	void closed(PipeMap::iterator pipe);
 
-	// Queue for wakes from 'pipes'.
-	queue<Sema *> wake;
+	// Forward output that is available in 'pipe' without waiting for more. 'buffer' is 'readSize' bytes.
+	void drain(Pipe pipe, char *buffer);
 
-	// Lock for 'toAdd' and 'toRemove'.
-	Lock editsLock;
+	// A watched handle was signaled.
+	void signaled(WatchMap::iterator watch, char *buffer);
 
 	// Running?
 	bool running;
@@ -104,9 +181,10 @@ private:
 	// Our global instance.
 	static OutputMgr me;
 
-	// Helpers for add and remove.
-	void addPipe(Pipe pipe, OutputState *state, nat skip, bool errorStream);
+	// Helpers for add, remove and watch.
+	void addPipe(Pipe pipe, OutputState *state, nat skip, bool errorStream, OutputBlock *block);
 	void removePipe(Pipe pipe);
+	bool watchHandle(Pipe handle, HandleWatch *watch, Pipe out, Pipe err);
 
 	// Main function for the thread.
 	void threadMain();
@@ -13,21 +13,23 @@
 #pragma comment(lib, "shlwapi.lib")
 #pragma comment(lib, "shell32.lib")
 
-static bool partEq(const String &a, const String &b) {
-	return _stricmp(a.c_str(), b.c_str()) == 0;
+static bool partEq(const char *a, nat aSize, const char *b, nat bSize) {
+	return aSize == bSize && _strnicmp(a, b, aSize) == 0;
 }
 
-static int partCmp(const String &a, const String &b) {
-	return _stricmp(a.c_str(), b.c_str());
+static int partCmp(const char *a, nat aSize, const char *b, nat bSize) {
+	int r = _strnicmp(a, b, min(aSize, bSize));
+	if (r != 0)
+		return r;
+	return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
 }
 
-static void partHash(size_t &state, const String &part) {
-	for (nat i = 0; i < part.size(); i++)
+static void partHash(size_t &state, const char *part, nat size) {
+	for (nat i = 0; i < size; i++)
 		state = ((state << 5) + state) + tolower(part[i]);
 }
 
 static const char separator = '\\';
-static const char *separatorStr = "\\";
 
 #else
 
@@ -36,25 +38,38 @@ static const char *separatorStr = "\\";
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
 
-static bool partEq(const String &a, const String &b) {
-	return a == b;
+static bool partEq(const char *a, nat aSize, const char *b, nat bSize) {
+	return aSize == bSize && memcmp(a, b, aSize) == 0;
 }
 
-static int partCmp(const String &a, const String &b) {
-	return strcmp(a.c_str(), b.c_str());
+static int partCmp(const char *a, nat aSize, const char *b, nat bSize) {
+	int r = memcmp(a, b, min(aSize, bSize));
+	if (r != 0)
+		return r;
+	return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
 }
 
-static void partHash(size_t &state, const String &part) {
-	for (nat i = 0; i < part.size(); i++)
+static void partHash(size_t &state, const char *part, nat size) {
+	for (nat i = 0; i < size; i++)
 		state = ((state << 5) + state) + part[i];
 }
 
 static const char separator = '/';
-static const char *separatorStr = "/";
 
 #endif
 
+// Initial value of the hash (djb2-inspired).
+static const size_t hashSeed = 5381;
+
+// Add a separator between two parts to the hash. Always '/', so that the hash of a path is the hash
+// of its string representation, regardless of which separators are used.
+static inline void partSep(size_t &state) {
+	state = ((state << 5) + state) + '/';
+}
+
 //////////////////////////////////////////////////////////////////////////
 // The Path class
 //////////////////////////////////////////////////////////////////////////
@@ -100,27 +115,26 @@ Path Path::config() {
 }
 
 void Path::deleteFile() const {
-	DeleteFile(toS(*this).c_str());
+	DeleteFile(buffer.c_str());
 }
 
 void Path::deleteDir() const {
-	RemoveDirectory(toS(*this).c_str());
+	RemoveDirectory(buffer.c_str());
 }
 
 bool Path::isAbsolute() const {
 	if (parts.size() == 0)
 		return false;
-	const String &first = parts.front();
-	if (first.size() < 2)
+	if (partSize(0) < 2)
 		return false;
-	return first[1] == L':';
+	return partBegin(0)[1] == L':';
 }
 
 vector<Path> Path::children() const {
 	vector<Path> result;
 	vector<std::pair<String, bool>> pieces;
 
-	String searchStr = toS(*this);
+	String searchStr = buffer;
 	if (!isDir())
 		searchStr += "\\";
 	searchStr += "*";
@@ -162,19 +176,19 @@ void Path::createDir() const {
 		return;
 
 	parent().createDir();
-	CreateDirectory(toS(*this).c_str(), NULL);
+	CreateDirectory(buffer.c_str(), NULL);
 }
 
 Timestamp fromFileTime(FILETIME ft);
 
 FileInfo Path::info() const {
 	FileInfo result(false);
-	HANDLE hFile = CreateFile(toS(*this).c_str(),
+	HANDLE hFile = CreateFile(buffer.c_str(),
 							0, /* We only want metadata */
 							FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, /* Allow access to others */
 							NULL, /* Security attributes */
 							OPEN_EXISTING, /* Action if not existing */
-							FILE_ATTRIBUTE_NORMAL,
+							FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS, /* Needed for directories */
 							NULL /* Template file */);
 	if (hFile != INVALID_HANDLE_VALUE) {
 		result.exists = true;
@@ -186,6 +200,11 @@ FileInfo Path::info() const {
 			// This is likely an implementation bug.
 			WARNING("Failed to retrieve file times for file " << *this);
 		}
+		BY_HANDLE_FILE_INFORMATION data;
+		if (GetFileInformationByHandle(hFile, &data) == TRUE) {
+			result.size = (nat64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			result.isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		}
 		CloseHandle(hFile);
 	}
 
@@ -194,7 +213,7 @@ FileInfo Path::info() const {
 
 // We can do exists() cheaper than stat() on Windows.
 bool Path::exists() const {
-	return GetFileAttributes(toS(*this).c_str()) != INVALID_FILE_ATTRIBUTES;
+	return GetFileAttributes(buffer.c_str()) != INVALID_FILE_ATTRIBUTES;
 }
 
 #else
@@ -237,57 +256,109 @@ Path Path::config() {
 }
 
 void Path::deleteFile() const {
-	unlink(toS(*this).c_str());
+	unlink(buffer.c_str());
 }
 
 void Path::deleteDir() const {
-	rmdir(toS(*this).c_str());
+	rmdir(buffer.c_str());
 }
 
 bool Path::isAbsolute() const {
 	if (parts.size() == 0)
 		return false;
-	return parts.front().empty();
+	return partSize(0) == 0;
 }
 
-vector<Path> Path::children() const {
-	vector<Path> result;
-	vector<std::pair<String, bool>> pieces;
-	String prefix = toS(*this);
-
-	DIR *h = opendir(prefix.c_str());
-	if (h == null)
-		return result;
+typedef vector<std::pair<String, bool>> DirPieces;
 
-	if (!prefix.empty() && prefix.back() != '/')
-		prefix += '/';
+// Add a directory entry to 'to'.
+static void addEntry(DirPieces &to, const String &prefix, const char *name, unsigned char type) {
+	if (strcmp(name, "..") == 0 || strcmp(name, ".") == 0)
+		return;
 
-	dirent *d;
+	bool dir = false;
 	struct stat s;
-	while ((d = readdir(h)) != null) {
-		if (strcmp(d->d_name, "..") != 0 && strcmp(d->d_name, ".") != 0) {
-			bool dir = false;
-
-			switch (d->d_type) {
-			case DT_UNKNOWN:
-			case DT_LNK:
-				if (stat((prefix + d->d_name).c_str(), &s) == 0) {
-					if (S_ISDIR(s.st_mode))
-						dir = true;
-				} else {
-					continue;
-				}
-				break;
-			case DT_DIR:
-				dir = true;
-				break;
-			}
 
-			pieces.push_back(std::pair<String, bool>(d->d_name, dir));
+	switch (type) {
+	case DT_UNKNOWN:
+	case DT_LNK:
+		if (stat((prefix + name).c_str(), &s) != 0)
+			return;
+		dir = S_ISDIR(s.st_mode);
+		break;
+	case DT_DIR:
+		dir = true;
+		break;
+	}
+
+	to.push_back(std::pair<String, bool>(name, dir));
+}
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+// Layout of the entries returned by getdents64.
+struct LinuxDirent {
+	nat64 ino;
+	int64 off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[1];
+};
+
+// Read the directory 'path' using getdents64 directly. This lets us use a larger buffer than
+// readdir does, so that large directories are read using fewer system calls.
+static bool readDir(const String &path, const String &prefix, DirPieces &to) {
+	int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	// Note: nat64 for alignment.
+	nat64 buffer[8192];
+	while (true) {
+		long r = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+		if (r <= 0)
+			break;
+
+		char *data = (char *)buffer;
+		for (long at = 0; at < r; ) {
+			LinuxDirent *d = (LinuxDirent *)(data + at);
+			addEntry(to, prefix, d->name, d->type);
+			at += d->reclen;
 		}
 	}
 
+	close(fd);
+	return true;
+}
+
+#else
+
+static bool readDir(const String &path, const String &prefix, DirPieces &to) {
+	DIR *h = opendir(path.c_str());
+	if (h == null)
+		return false;
+
+	dirent *d;
+	while ((d = readdir(h)) != null)
+		addEntry(to, prefix, d->d_name, d->d_type);
+
 	closedir(h);
+	return true;
+}
+
+#endif
+
+vector<Path> Path::children() const {
+	vector<Path> result;
+	DirPieces pieces;
+	const String &path = buffer;
+
+	String prefix = path;
+	if (!prefix.empty() && prefix.back() != '/')
+		prefix += '/';
+
+	if (!readDir(path, prefix, pieces))
+		return result;
 
 	std::sort(pieces.begin(), pieces.end());
 
@@ -309,7 +380,7 @@ void Path::createDir() const {
 		return;
 
 	parent().createDir();
-	mkdir(toS(*this).c_str(), 0777);
+	mkdir(buffer.c_str(), 0777);
 }
 
 Timestamp fromFileTime(time_t);
@@ -318,10 +389,12 @@ FileInfo Path::info() const {
 	FileInfo result(false);
 
 	struct stat s;
-	if (stat(toS(*this).c_str(), &s) == 0) {
+	if (stat(buffer.c_str(), &s) == 0) {
 		result.exists = true;
 		result.mTime = fromFileTime(s.st_mtime);
 		result.cTime = fromFileTime(s.st_ctime);
+		result.size = s.st_size;
+		result.isDir = S_ISDIR(s.st_mode);
 	}
 
 	return result;
@@ -329,7 +402,7 @@ FileInfo Path::info() const {
 
 bool Path::exists() const {
 	struct stat s;
-	return stat(toS(*this).c_str(), &s) == 0;
+	return stat(buffer.c_str(), &s) == 0;
 }
 
 #endif
@@ -343,56 +416,188 @@ Timestamp Path::cTime() const {
 }
 
 bool Path::equal(const String &a, const String &b) {
-	return partEq(a, b);
+	return partEq(a.c_str(), a.size(), b.c_str(), b.size());
 }
 
 int Path::compare(const String &a, const String &b) {
-	return partCmp(a, b);
+	return partCmp(a.c_str(), a.size(), b.c_str(), b.size());
+}
+
+Path::Path(const String &str) : isDirectory(false), hashValue(hashSeed) {
+	PartList p;
+	bool dir = false;
+
+	if (!str.empty()) {
+		nat numPaths = std::count(str.begin(), str.end(), '\\');
+		numPaths += std::count(str.begin(), str.end(), '/');
+		p.reserve(numPaths + 1);
+
+		if (str[0] == '\\' || str[0] == '/') {
+			Part root = { str.c_str(), 0 };
+			p.push_back(root);
+		}
+
+		nat startAt = 0;
+		for (nat i = 0; i < str.size(); i++) {
+			if (str[i] == '\\' || str[i] == '/') {
+				if (i > startAt) {
+					Part part = { str.c_str() + startAt, i - startAt };
+					p.push_back(part);
+				}
+				startAt = i + 1;
+			}
+		}
+
+		if (str.size() > startAt) {
+			Part part = { str.c_str() + startAt, nat(str.size() - startAt) };
+			p.push_back(part);
+		} else {
+			dir = true;
+		}
+	}
+
+	simplify(p);
+	build(p, dir);
 }
 
-Path::Path(const String &path) : isDirectory(false) {
-	parseStr(path);
-	simplify();
+Path::Path() : buffer("."), isDirectory(false), hashValue(hashSeed) {}
+
+nat Path::partSize(nat id) const {
+	nat end;
+	if (id + 1 < parts.size())
+		end = parts[id + 1] - 1;
+	else
+		end = nat(buffer.size()) - (isDirectory ? 1 : 0);
+	return end - parts[id];
 }
 
-Path::Path() : isDirectory(false) {}
+String Path::part(nat id) const {
+	return String(partBegin(id), partSize(id));
+}
 
-void Path::parseStr(const String &str) {
-	if (str.empty())
-		return;
+void Path::partList(PartList &to) const {
+	for (nat i = 0; i < parts.size(); i++) {
+		Part p = { partBegin(i), partSize(i) };
+		to.push_back(p);
+	}
+}
 
-	nat numPaths = std::count(str.begin(), str.end(), '\\');
-	numPaths += std::count(str.begin(), str.end(), '/');
-	parts.reserve(numPaths + 1);
+void Path::build(const PartList &src, bool dir) {
+	// Note: 'src' may refer to our own buffer, so we build the new representation separately.
+	nat total = 2;
+	for (nat i = 0; i < src.size(); i++)
+		total += src[i].size + 1;
 
-	if (str[0] == '\\' || str[0] == '/')
-		parts.push_back("");
+	String b;
+	b.reserve(total);
+	vector<nat> offsets;
+	offsets.reserve(src.size());
+	size_t h = hashSeed;
 
-	nat startAt = 0;
-	for (nat i = 0; i < str.size(); i++) {
-		if (str[i] == '\\' || str[i] == '/') {
-			if (i > startAt) {
-				parts.push_back(str.substr(startAt, i - startAt));
-			}
-			startAt = i + 1;
+	for (nat i = 0; i < src.size(); i++) {
+		if (i > 0) {
+			b += separator;
+			partSep(h);
 		}
+		offsets.push_back(nat(b.size()));
+		b.append(src[i].begin, src[i].size);
+		partHash(h, src[i].begin, src[i].size);
 	}
 
-	if (str.size() > startAt) {
-		parts.push_back(str.substr(startAt));
-		isDirectory = false;
-	} else {
-		isDirectory = true;
+	if (src.empty())
+		b = ".";
+	if (dir)
+		b += separator;
+
+	buffer.swap(b);
+	parts.swap(offsets);
+	isDirectory = dir;
+	hashValue = h;
+}
+
+void Path::append(const char *begin, nat size) {
+	if (parts.empty())
+		buffer.clear();
+	else if (!isDirectory)
+		buffer += separator;
+
+	if (!parts.empty())
+		partSep(hashValue);
+
+	parts.push_back(nat(buffer.size()));
+	buffer.append(begin, size);
+	isDirectory = false;
+
+	partHash(hashValue, begin, size);
+}
+
+void Path::replaceTitle(const String &title) {
+	buffer.resize(parts.back());
+	buffer += title;
+	if (isDirectory)
+		buffer += separator;
+	rehash();
+}
+
+void Path::rehash() {
+	hashValue = hashSeed;
+	for (nat i = 0; i < parts.size(); i++) {
+		if (i > 0)
+			partSep(hashValue);
+		partHash(hashValue, partBegin(i), partSize(i));
 	}
 }
 
-void Path::simplify() {
-	vector<String>::iterator i = parts.begin();
+size_t Path::hash(const String &str) {
+	const char *s = str.c_str();
+	nat size = nat(str.size());
+
+	// Directories end with a separator, which is not a part of the hash.
+	if (size > 0 && (s[size - 1] == '\\' || s[size - 1] == '/'))
+		size--;
+
+	// The empty path.
+	if (size == 1 && s[0] == '.')
+		return hashSeed;
+
+	size_t h = hashSeed;
+	nat start = 0;
+	for (nat i = 0; i < size; i++) {
+		if (s[i] == '\\' || s[i] == '/') {
+			partHash(h, s + start, i - start);
+			partSep(h);
+			start = i + 1;
+		}
+	}
+	partHash(h, s + start, size - start);
+	return h;
+}
+
+static inline bool isDot(const char *begin, nat size) {
+	return size == 1 && begin[0] == '.';
+}
+
+static inline bool isDotDot(const char *begin, nat size) {
+	return size == 2 && begin[0] == '.' && begin[1] == '.';
+}
+
+bool Path::needsSimplify() const {
+	for (nat i = 0; i < parts.size(); i++) {
+		const char *begin = partBegin(i);
+		nat size = partSize(i);
+		if (isDot(begin, size) || isDotDot(begin, size))
+			return true;
+	}
+	return false;
+}
+
+void Path::simplify(PartList &parts) {
+	PartList::iterator i = parts.begin();
 	while (i != parts.end()) {
-		if (*i == ".") {
+		if (isDot(i->begin, i->size)) {
 			// Safely removed.
 			i = parts.erase(i);
-		} else if (*i == ".." && i != parts.begin() && *(i - 1) != "..") {
+		} else if (isDotDot(i->begin, i->size) && i != parts.begin() && !isDotDot((i - 1)->begin, (i - 1)->size)) {
 			// Remove previous path.
 			i = parts.erase(--i);
 			i = parts.erase(i);
@@ -404,23 +609,19 @@ void Path::simplify() {
 }
 
 std::ostream &operator <<(std::ostream &to, const Path &path) {
-	join(to, path.parts, separatorStr);
-	if (path.parts.empty())
-		to << '.';
-	if (path.isDir()) to << separatorStr;
-	return to;
+	return to << path.buffer;
 }
 
 bool Path::operator ==(const Path &o) const {
 	if (isDirectory != o.isDirectory)
 		return false;
-	if (parts.size() != o.parts.size())
+	if (hashValue != o.hashValue)
+		return false;
+	if (parts != o.parts)
 		return false;
 
-	for (nat i = 0; i < parts.size(); i++)
-		if (!partEq(parts[i], o.parts[i]))
-			return false;
-	return true;
+	// Parts are at the same locations, so we can compare the entire buffers.
+	return equal(buffer, o.buffer);
 }
 
 bool Path::operator <(const Path &o) const {
@@ -428,7 +629,7 @@ bool Path::operator <(const Path &o) const {
 		if (o.parts.size() <= i)
 			return false;
 
-		int r = partCmp(parts[i], o.parts[i]);
+		int r = partCmp(partBegin(i), partSize(i), o.partBegin(i), o.partSize(i));
 		if (r != 0)
 			return r < 0;
 	}
@@ -446,17 +647,6 @@ bool Path::operator >(const Path &o) const {
 	return o < *this;
 }
 
-size_t Path::hash() const {
-	// djb2-inspired hash
-	size_t r = 5381;
-	for (nat i = 0; i < parts.size(); i++) {
-		partHash(r, parts[i]);
-		r = ((r << 5) + r) + '/'; // To differentiate between different divisions of slashes.
-	}
-
-	return r;
-}
-
 
 Path Path::operator +(const Path &other) const {
 	Path result(*this);
@@ -466,37 +656,83 @@ Path Path::operator +(const Path &other) const {
 
 Path &Path::operator +=(const Path &other) {
 	assert(!other.isAbsolute());
-	isDirectory = other.isDirectory;
-	parts.insert(parts.end(), other.parts.begin(), other.parts.end());
-	simplify();
+	if (&other == this) {
+		Path copy(other);
+		return *this += copy;
+	}
+
+	if (needsSimplify() || other.needsSimplify()) {
+		PartList p;
+		p.reserve(parts.size() + other.parts.size());
+		partList(p);
+		other.partList(p);
+		simplify(p);
+		build(p, other.isDirectory);
+		return *this;
+	}
+
+	for (nat i = 0; i < other.parts.size(); i++)
+		append(other.partBegin(i), other.partSize(i));
+
+	if (other.isDirectory) {
+		makeDir();
+	} else if (isDirectory) {
+		buffer.erase(buffer.size() - 1);
+		isDirectory = false;
+	}
 	return *this;
 }
 
 Path Path::operator +(const String &name) const {
-	Path result(*this);
+	// Make room for the new part right away, to avoid reallocating the copy.
+	Path result;
+	result.buffer.reserve(buffer.size() + name.size() + 1);
+	result.buffer = buffer;
+	result.parts.reserve(parts.size() + 1);
+	result.parts = parts;
+	result.isDirectory = isDirectory;
+	result.hashValue = hashValue;
 	result += name;
 	return result;
 }
 
 Path &Path::operator +=(const String &name) {
-	parts.push_back(name);
-	isDirectory = false;
+	append(name.c_str(), nat(name.size()));
 	return *this;
 }
 
+void Path::makeDir() {
+	if (isDirectory)
+		return;
+
+	isDirectory = true;
+	buffer += separator;
+}
+
 Path Path::parent() const {
-	Path result(*this);
-	result.parts.pop_back();
+	Path result;
+	if (parts.size() <= 1) {
+		result.makeDir();
+		return result;
+	}
+
+	result.buffer.assign(buffer, 0, parts.back());
+	result.parts.assign(parts.begin(), parts.end() - 1);
 	result.isDirectory = true;
+	result.rehash();
 	return result;
 }
 
 String Path::first() const {
-	return parts.front();
+	if (parts.empty())
+		return "";
+	return part(0);
 }
 
 String Path::title() const {
-	return parts.back();
+	if (parts.empty())
+		return "";
+	return part(nat(parts.size() - 1));
 }
 
 String Path::titleNoExt() const {
@@ -516,14 +752,14 @@ String Path::ext() const {
 
 void Path::makeExt(const String &str) {
 	if (str.empty()) {
-		parts.back() = titleNoExt();
+		replaceTitle(titleNoExt());
 	} else {
-		parts.back() = titleNoExt() + "." + str;
+		replaceTitle(titleNoExt() + "." + str);
 	}
 }
 
 void Path::makeTitle(const String &str) {
-	parts.back() = str;
+	replaceTitle(str);
 }
 
 bool Path::isDir() const {
@@ -535,30 +771,27 @@ bool Path::isEmpty() const {
 }
 
 Path Path::makeRelative(const Path &to) const {
-	Path result;
-	result.isDirectory = isDirectory;
-
-	bool equal = true;
 	nat consumed = 0;
-
-	for (nat i = 0; i < to.parts.size(); i++) {
-		if (!equal) {
-			result.parts.push_back("..");
-		} else if (i >= parts.size()) {
-			result.parts.push_back("..");
-			equal = false;
-		} else if (!partEq(to.parts[i], parts[i])) {
-			result.parts.push_back("..");
-			equal = false;
-		} else {
-			consumed++;
-		}
+	while (consumed < to.parts.size() && consumed < parts.size()) {
+		if (!partEq(to.partBegin(consumed), to.partSize(consumed), partBegin(consumed), partSize(consumed)))
+			break;
+		consumed++;
 	}
 
-	for (nat i = consumed; i < parts.size(); i++) {
-		result.parts.push_back(parts[i]);
-	}
+	// Each remaining part in 'to' needs a '..'.
+	nat up = nat(to.parts.size()) - consumed;
 
+	Path result;
+	result.buffer.reserve(up * 3 + buffer.size() + 1);
+	result.parts.reserve(up + parts.size() - consumed);
+
+	for (nat i = 0; i < up; i++)
+		result.append("..", 2);
+	for (nat i = consumed; i < parts.size(); i++)
+		result.append(partBegin(i), partSize(i));
+
+	if (isDirectory)
+		result.makeDir();
 	return result;
 }
 
@@ -577,12 +810,22 @@ bool Path::isChild(const Path &path) const {
 	if (parts.size() <= path.parts.size())
 		return false;
 
-	for (nat i = 0; i < path.parts.size(); i++) {
-		if (!partEq(parts[i], path.parts[i]))
+	nat count = nat(path.parts.size());
+	if (count == 0)
+		return true;
+
+	// If the parts are equal, they are at the same locations and we can compare the buffers at once.
+	for (nat i = 0; i < count; i++)
+		if (parts[i] != path.parts[i])
 			return false;
-	}
 
-	return true;
+	nat last = count - 1;
+	nat size = partSize(last);
+	if (size != path.partSize(last))
+		return false;
+
+	nat length = parts[last] + size;
+	return partEq(buffer.c_str(), length, path.buffer.c_str(), length);
 }
 
 void Path::recursiveDelete() const {
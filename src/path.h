@@ -10,7 +10,7 @@ class FileInfo {
 public:
 	// Create.
 	FileInfo(bool exists, Timestamp cTime = Timestamp(0), Timestamp mTime = Timestamp(0))
-		: exists(exists), cTime(cTime), mTime(mTime) {}
+		: exists(exists), cTime(cTime), mTime(mTime), size(0), isDir(false) {}
 
 	// Does the file exist?
 	bool exists;
@@ -20,6 +20,12 @@ public:
 
 	// Modified time. 0 if the file does not exist.
 	Timestamp mTime;
+
+	// Size in bytes. 0 if the file does not exist.
+	nat64 size;
+
+	// Is this a directory?
+	bool isDir;
 };
 
 
@@ -73,7 +79,7 @@ public:
 	bool isEmpty() const;
 
 	// Make this obj a directory.
-	inline void makeDir() { isDirectory = true; }
+	void makeDir();
 
 	// Get parent directory.
 	Path parent() const;
@@ -130,20 +136,66 @@ public:
 	// Create this path as directory if it does not already exist.
 	void createDir() const;
 
-	// Hash.
-	size_t hash() const;
+	// Hash. Computed whenever the path is modified.
+	inline size_t hash() const { return hashValue; }
+
+	// Compute the hash of a path from its string representation (as returned by 'str'), without
+	// creating a Path. Used to look up paths by strings in hash tables.
+	static size_t hash(const String &str);
+
+	// String representation, the same as 'toS' produces. Stored inside the path, so it is cheap.
+	inline const String &str() const { return buffer; }
 
 private:
+	// A part of a path, used while building paths.
+	struct Part {
+		const char *begin;
+		nat size;
+	};
+	typedef vector<Part> PartList;
+
+	// Internal representation is the string representation of the path, where each part of the path
+	// is separated by the separator of the current OS. Directories end with a separator. The empty
+	// path is represented as "." (or "./" if it is a directory).
+	String buffer;
 
-	// Internal representation is a list of strings, one for each part of the pathname.
-	vector<String> parts;
+	// Offset of the start of each part of the path inside 'buffer'.
+	vector<nat> parts;
 
 	// Is this a directory?
 	bool isDirectory;
 
-	// Parse a path string.
-	void parseStr(const String &str);
+	// Hash of the parts.
+	size_t hashValue;
+
+	// Get the start and the size of a part.
+	inline const char *partBegin(nat id) const { return buffer.c_str() + parts[id]; }
+	nat partSize(nat id) const;
+	String part(nat id) const;
 
-	// Simplify a path string, which means to remove any . and ..
-	void simplify();
+	// Get all parts.
+	void partList(PartList &to) const;
+
+	// Replace the contents with the parts in 'src'.
+	void build(const PartList &src, bool dir);
+
+	// Append a part to the end of the path.
+	void append(const char *begin, nat size);
+
+	// Replace the last part.
+	void replaceTitle(const String &title);
+
+	// Compute the hash from scratch.
+	void rehash();
+
+	// Does any part contain . or ..?
+	bool needsSimplify() const;
+
+	// Simplify a list of parts, which means to remove any . and ..
+	static void simplify(PartList &parts);
 };
+
+// Convert to string, without going through a stringstream.
+inline String toS(const Path &p) {
+	return p.str();
+}
@@ -0,0 +1,60 @@
+#include "std.h"
+#include "pathtable.h"
+#include "arena.h"
+
+PathTable PathTable::me;
+
+PathTable::PathTable() : size(0) {
+	for (nat i = 0; i < maxChunks; i++)
+		chunks[i] = null;
+}
+
+PathTable::~PathTable() {
+	// This is only destroyed when the process exits.
+	if (!Arena::teardown())
+		return;
+
+	for (nat i = 0; i < maxChunks; i++)
+		delete []chunks[i];
+}
+
+PathId PathTable::id(const Path &path) {
+	Lock::Guard z(me.lock);
+
+	IdSet::const_iterator found = me.ids.find(path);
+	if (found != me.ids.end())
+		return *found;
+
+	PathId id = me.size;
+	nat chunk = id >> chunkBits;
+	if (chunk >= maxChunks) {
+		WARNING("Too many paths in the path table.");
+		exit(12);
+	}
+	if (!me.chunks[chunk])
+		me.chunks[chunk] = new Path[chunkSize];
+
+	me.chunks[chunk][id & chunkMask] = path;
+	me.size++;
+	me.ids.insert(id);
+
+	return id;
+}
+
+PathId PathTable::id(const String &str) {
+	{
+		Lock::Guard z(me.lock);
+		IdSet::const_iterator found = me.ids.find(str);
+		if (found != me.ids.end())
+			return *found;
+	}
+
+	// Note: 'str' may not be in the form produced by Path::str (e.g. it may contain '..'), so look
+	// again using the Path.
+	return id(Path(str));
+}
+
+nat PathTable::count() {
+	Lock::Guard z(me.lock);
+	return me.size;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "path.h"
+#include "hash.h"
+#include "sync.h"
+
+// Identifier of a path in the PathTable. IDs are dense, starting at zero.
+typedef nat PathId;
+
+/**
+ * Global table of all paths examined during a build.
+ *
+ * Each distinct path is stored once and assigned a small integer ID. Large structures, such as the
+ * include graph, store IDs rather than paths. This means that they can use vectors indexed by ID
+ * rather than maps keyed by paths, and that each path string is only stored once no matter how
+ * many files refer to it.
+ *
+ * Paths are never removed from the table, and the references returned by 'path' stay valid until
+ * the program exits.
+ *
+ * Note: This class is thread-safe. Looking up a path from an ID does not require any locks.
+ */
+class PathTable : NoCopy {
+public:
+	// Clean up.
+	~PathTable();
+
+	// Get the ID of 'path', adding it to the table if needed.
+	static PathId id(const Path &path);
+
+	// Get the ID of the path with the string representation 'str'. Only creates a Path if 'str' is
+	// not already in the table.
+	static PathId id(const String &str);
+
+	// Get the path with the ID 'id'.
+	static inline const Path &path(PathId id) {
+		return me.chunks[id >> chunkBits][id & chunkMask];
+	}
+
+	// Number of paths in the table. All IDs are smaller than this.
+	static nat count();
+
+	// Compare two IDs by the paths they refer to.
+	static inline bool less(PathId a, PathId b) {
+		return path(a) < path(b);
+	}
+
+private:
+	// Disallow creation.
+	PathTable();
+
+	// Our global instance.
+	static PathTable me;
+
+	// Paths are stored in chunks that are never moved, so that references to them stay valid and
+	// so that 'path' can read them while other threads add paths.
+	enum {
+		chunkBits = 12,
+		chunkSize = 1 << chunkBits,
+		chunkMask = chunkSize - 1,
+		maxChunks = 4096,
+	};
+	Path *chunks[maxChunks];
+
+	// Lock for everything except reading 'chunks'.
+	Lock lock;
+
+	// Number of paths in the table.
+	nat size;
+
+	// Hashing of IDs in 'ids'. IDs are looked up by their paths, or by strings.
+	struct IdHash {
+		static size_t hash(PathId id) { return path(id).hash(); }
+		static size_t hash(const Path &p) { return p.hash(); }
+		static size_t hash(const String &s) { return Path::hash(s); }
+
+		static bool equal(PathId a, PathId b) { return a == b; }
+		static bool equal(PathId a, const Path &b) { return path(a) == b; }
+		static bool equal(PathId a, const String &b) { return Path::equal(path(a).str(), b); }
+	};
+
+	// All IDs, so that paths don't need to be stored twice.
+	typedef FlatSet<PathId, IdHash> IdSet;
+	IdSet ids;
+};
@@ -65,6 +65,16 @@ bool writePipe(Pipe to, const void *data, nat size) {
 	return WriteFile(to, data, size, &written, NULL) == TRUE;
 }
 
+Pipe stdPipe(bool errorStream) {
+	return GetStdHandle(errorStream ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
+}
+
+bool readPipe(Pipe, void *, nat, nat &) {
+	// Pipes in a PipeSet always have a read in progress, so we can not read from them here. This is
+	// only used when OutputMgr watches processes, which we do not do on Windows.
+	return false;
+}
+
 class PipeSet : NoCopy {
 public:
 	PipeSet(nat bufSize);
@@ -254,8 +264,8 @@ void readPipeSet(PipeSet *pipes, void *to, nat &written, Pipe &from) {
 
 #else
 
-#include <sys/select.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 const Pipe noPipe = -1;
@@ -302,6 +312,157 @@ bool writePipe(Pipe to, const void *data, nat size) {
 	return true;
 }
 
+Pipe stdPipe(bool errorStream) {
+	return errorStream ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+bool readPipe(Pipe from, void *to, nat size, nat &written) {
+	pollfd p = { from, POLLIN, 0 };
+	int ready;
+	do {
+		ready = poll(&p, 1, 0);
+	} while (ready < 0 && errno == EINTR);
+
+	if (ready <= 0)
+		return false;
+
+	ssize_t r;
+	do {
+		r = read(from, to, size);
+	} while (r < 0 && errno == EINTR);
+
+	written = r > 0 ? nat(r) : 0;
+	return true;
+}
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <cstring>
+
+// Size we try to enlarge pipes to, so that chatty processes don't block on a full pipe while we are
+// busy with output from other processes. The default is 64 KiB. Note that the total size of all
+// pipes of a user is limited, if we exceed that limit the pipes simply keep their default size.
+static const int pipeSize = 256 * 1024;
+
+class PipeSet : NoCopy {
+public:
+	PipeSet(nat bufferSize);
+	~PipeSet();
+
+	nat bufferSize;
+
+	// The epoll instance.
+	int epoll;
+
+	// Number of pipes in the set.
+	nat count;
+
+	// Events from the last call to 'epoll_wait'. Events in 'events[nextEvent..eventCount)' are not
+	// yet handled. Events for pipes that were removed have their fd set to -1.
+	enum {
+		maxEvents = 64
+	};
+	epoll_event events[maxEvents];
+	nat eventCount;
+	nat nextEvent;
+
+	void add(Pipe pipe);
+	void remove(Pipe pipe);
+	void read(void *to, nat &written, Pipe &from);
+};
+
+PipeSet::PipeSet(nat bufferSize) : bufferSize(bufferSize), count(0), eventCount(0), nextEvent(0) {
+	epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll < 0) {
+		perror("Failed to create epoll instance: ");
+		exit(11);
+	}
+}
+
+PipeSet::~PipeSet() {
+	close(epoll);
+}
+
+void PipeSet::add(Pipe p) {
+#ifdef F_SETPIPE_SZ
+	if (fcntl(p, F_GETPIPE_SZ) < pipeSize)
+		fcntl(p, F_SETPIPE_SZ, pipeSize);
+#endif
+
+	epoll_event e;
+	zeroMem(e);
+	e.events = EPOLLIN;
+	e.data.fd = p;
+	if (epoll_ctl(epoll, EPOLL_CTL_ADD, p, &e)) {
+		perror("Failed to add a pipe to epoll: ");
+		exit(11);
+	}
+	count++;
+}
+
+void PipeSet::remove(Pipe p) {
+	// Note: This is called both when we see the end of the stream and by the user.
+	if (epoll_ctl(epoll, EPOLL_CTL_DEL, p, null))
+		return;
+	count--;
+
+	// The fd may be reused before we get to any events that are left.
+	for (nat i = nextEvent; i < eventCount; i++)
+		if (events[i].data.fd == p)
+			events[i].data.fd = -1;
+}
+
+void PipeSet::read(void *to, nat &written, Pipe &from) {
+	written = 0;
+	from = noPipe;
+
+	while (from == noPipe) {
+		if (nextEvent >= eventCount) {
+			if (count == 0) {
+				WARNING("No fds to read from!");
+				sleep(1);
+				return;
+			}
+
+			int ready = epoll_wait(epoll, events, maxEvents, -1);
+			if (ready < 0) {
+				if (errno != EINTR) {
+					perror("Failed to wait using epoll: ");
+					exit(11);
+				}
+
+				// No big deal if we happen to wake up...
+				return;
+			}
+
+			eventCount = nat(ready);
+			nextEvent = 0;
+		} else {
+			from = events[nextEvent++].data.fd;
+		}
+	}
+
+	ssize_t r;
+	do {
+		r = ::read(from, to, bufferSize);
+	} while (r < 0 && errno == EINTR);
+
+	if (r == 0) {
+		// Closed fd. Ignore it until the manager detects it is closed.
+		remove(from);
+		written = 0;
+	} else if (r < 0) {
+		written = 0;
+	} else {
+		written = r;
+	}
+}
+
+#else
+
+#include <sys/select.h>
+
 class PipeSet : NoCopy {
 public:
 	PipeSet(nat bufferSize);
@@ -325,6 +486,11 @@ PipeSet::PipeSet(nat bufferSize) : bufferSize(bufferSize), maxFd(0), lastFd(0) {
 PipeSet::~PipeSet() {}
 
 void PipeSet::add(Pipe p) {
+	if (p >= FD_SETSIZE) {
+		WARNING("The fd " << p << " is too large for select!");
+		exit(11);
+	}
+
 	FD_SET(p, &fds);
 	maxFd = max(maxFd, p + 1);
 }
@@ -393,6 +559,8 @@ void PipeSet::read(void *to, nat &written, Pipe &from) {
 
 
 
+#endif
+
 PipeSet *createPipeSet(nat bufferSize) {
 	return new PipeSet(bufferSize);
 }
@@ -23,6 +23,14 @@ void closePipe(Pipe p);
 // Write to a pipe.
 bool writePipe(Pipe to, const void *data, nat size);
 
+// Get the standard output or standard error of this process.
+Pipe stdPipe(bool errorStream);
+
+// Read from a pipe if there is data available, without waiting for more. Returns false if there is
+// nothing to read. Otherwise, 'written' is set to the number of bytes read, which is zero at the end
+// of stream. Not supported on Windows, where it always returns false.
+bool readPipe(Pipe from, void *to, nat size, nat &written);
+
 
 /**
  * Set of pipes that allows waiting until data on one of the pipes.
@@ -36,7 +44,9 @@ PipeSet *createPipeSet(nat bufferSize);
 // Destroy a pipe set.
 void destroyPipeSet(PipeSet *pipes);
 
-// Add a pipe to a pipe set.
+// Add a pipe to a pipe set. On POSIX systems, 'pipe' may be any file descriptor that can be waited
+// for (e.g. a pidfd). If reading from it fails, 'readPipeSet' reports it with 'written = 0', but it is
+// not removed from the set.
 void addPipeSet(PipeSet *pipes, Pipe pipe);
 
 // Remove a pipe from a pipe set.
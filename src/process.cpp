@@ -1,6 +1,10 @@
 #include "std.h"
 #include "process.h"
 #include "outputmgr.h"
+#include "outputblock.h"
+#include "jobserver.h"
+#include "throttle.h"
+#include "buildstats.h"
 
 /**
  * Global process-synchronization variables.
@@ -9,144 +13,244 @@
 // Global process limit.
 static nat procLimit = 1;
 
+// Adaptive process limit, if enabled. Updates 'procLimit'. Protected by 'aliveLock'.
+static Throttle *throttle = null;
+
 // Global active processes.
 static ProcMap alive;
 
 // Global lock for 'alive'.
 static Lock aliveLock;
 
-// System-specific logic to re-try the waiting (e.g. when a new process should be added to the list
-// of waiting processes).
-static void systemNewProc();
+// Number of processes that ProcGroup::spawn has decided to start, but that are not yet in
+// 'alive'. Protected by 'aliveLock'.
+static nat starting = 0;
 
-// System-specific waiting logic. Returns the process id that terminated.
-static bool systemWaitProc(ProcId &proc, int &result);
+// Number of jobserver tokens we are holding. We always have one implicit job slot, so this is at
+// least one less than the number of running processes. Protected by 'aliveLock'.
+static nat tokens = 0;
 
-// Wait for any process we're monitoring to terminate, and handle that event.
-// Assumes that it is not called from multiple threads. Use 'waitFor' to ensure this.
-void waitProc() {
-	ProcId exited;
-	int result;
-	if (!systemWaitProc(exited, result))
-		return;
+// Limit memory usage? Protected by 'aliveLock'.
+static bool memoryLimited = false;
 
-	Process *p = null;
+// Use the available memory as the limit, rather than a fixed value? Protected by 'aliveLock'.
+static bool memoryAuto = false;
 
-	{
-		Lock::Guard z(aliveLock);
-		ProcMap::const_iterator i = alive.find(exited);
+// Memory limit, in bytes. Protected by 'aliveLock'.
+static nat64 memoryBudget = 0;
 
-		if (i == alive.end())
-			return;
+// Memory reserved by processes that are starting or running. Protected by 'aliveLock'.
+static nat64 memoryReserved = 0;
 
-		p = i->second;
-		alive.erase(i);
-	}
+// Limit on the number of processes after a process was killed since the system ran out of
+// memory. Zero if no limit. Protected by 'aliveLock'.
+static nat oomLimit = 0;
 
-	if (!p)
-		return;
+// Maximum number of times a process is restarted after running out of memory.
+static const nat maxRetries = 2;
+
+// Terminate all processes started by a ProcGroup as soon as one of them fails? Protected by 'aliveLock'.
+static bool failFast = false;
+
+// Have all processes been terminated after a failure? Set while holding 'aliveLock', but also read
+// without it, like 'ProcGroup::failed'.
+static volatile bool cancelled = false;
+
+/**
+ * A build worker (see worker.h).
+ */
+class RemoteWorker {
+public:
+	RemoteWorker(const String &address, nat slots) : address(address), slots(slots), running(0) {}
+
+	// Address.
+	String address;
+
+	// Number of slots.
+	nat slots;
 
-	p->terminated(result);
+	// Number of processes running on the worker.
+	nat running;
+};
+
+// All workers. Protected by 'aliveLock'.
+static vector<RemoteWorker> workers;
+
+// Number of processes in 'alive' or 'starting' that are executed on workers. Protected by 'aliveLock'.
+static nat remoteRunning = 0;
 
-	if (p->owner)
-		p->owner->terminated(p, result);
+// Number of processes executed locally. Assumes 'aliveLock' is held.
+static nat localRunning() {
+	return alive.size() + starting - remoteRunning;
 }
 
-ProcessCallback::~ProcessCallback() {}
+// Return any jobserver tokens we do not need anymore. Assumes 'aliveLock' is held.
+static void releaseTokens() {
+	while (tokens > 0 && localRunning() <= tokens) {
+		JobServer::release();
+		tokens--;
+	}
+}
 
-class WaitCond {
-public:
-	WaitCond() : next(null), sema(0), manager(false) {}
+// System-specific logic for a new process in 'alive'. Returns true if the process is watched by
+// OutputMgr, which calls 'procExited' when it terminates. Otherwise, a reaper thread needs to wait
+// for it using 'systemWaitProc'. Called with 'aliveLock' held.
+static bool systemNewProc(ProcId proc, Pipe out, Pipe err);
 
-	// Next in the list.
-	WaitCond *next;
+// System-specific waiting logic, used by the reaper threads. Waits for 'proc' to terminate.
+static bool systemWaitProc(ProcId proc, int &result, ProcStats &stats);
 
-	// Semaphore used for waiting.
-	Sema sema;
+// Set up anything needed for 'systemCancel' when fail-fast mode is enabled.
+static void systemFailFast();
 
-	// Is this the manager at the moment?
-	bool manager;
+// Terminate the processes 'procs', which have 'killed' set. Called with 'aliveLock' held.
+static void systemCancel(const vector<ProcId> &procs);
 
-	// Are we done?
-	virtual bool done() = 0;
-};
+// Memory currently available in the system, in bytes.
+static nat64 systemAvailableMemory();
 
-// All conditions currently being waited for.
-static WaitCond *waiters = null;
+// Number of processes in our part of the system (e.g. our cgroup) that were killed since the system
+// ran out of memory, if available.
+static nat64 systemOomKills();
 
-// Lock for the waiters.
-static Lock waitersLock;
+// Was a process killed because the system ran out of memory? 'result' is its result, and
+// 'oomKills' is the value of 'systemOomKills' when it was started.
+static bool systemOutOfMemory(int result, nat64 oomKills);
 
-// Wait until 'cond' returns true. The condition may be evaluated both when 'waitLock' is held and
-// when it is not held.
-void waitFor(WaitCond &cond) {
+// Lock and condition for 'waitFor'. The condition is signaled whenever something 'waitFor' may be
+// waiting for has changed, i.e. mostly when a process terminated.
+static Lock waitLock;
+static CondVar waitCond;
+
+// Wake all threads in 'waitFor', so that they check their conditions again.
+static void notifyWaiters() {
+	Lock::Guard z(waitLock);
+	waitCond.broadcast();
+}
+
+// Serializes calls to 'procExited', so that callbacks don't have to be thread safe.
+static Lock exitedLock;
+
+// Handle that the process 'exited' terminated. Called from the thread that found out, which is
+// either the thread of the OutputMgr or the reaper thread.
+void procExited(ProcId exited, int result, const ProcStats &stats) {
 	{
-		Lock::Guard z(waitersLock);
+		Lock::Guard e(exitedLock);
+		Process *p = null;
 
-		if (cond.done())
-			return;
+		{
+			Lock::Guard z(aliveLock);
+			ProcMap::const_iterator i = alive.find(exited);
 
-		// Need to wait.
-		cond.manager = waiters == null;
-		cond.next = waiters;
-		waiters = &cond;
-
-		// If we are the manager already, up our own semaphore so that we don't have to sleep.
-		if (cond.manager)
-			cond.sema.up();
-	}
-
-	// Sleep until it is either our turn to become the manager, or until we're done.
-	cond.sema.down();
-
-	// Either, we were the manager from the start, or we have become the new manager.
-	if (cond.manager) {
-		// The first thread is responsible for calling 'waitProc'.
-		while (true) {
-			waitProc();
-
-			Lock::Guard w(waitersLock);
-
-			// Check the other conditions, possibly waking them.
-			WaitCond **i = &waiters;
-			while (*i) {
-				WaitCond *curr = *i;
-				if (*i == &cond) {
-					// This is us, remove it!
-					*i = curr->next;
-				} else if ((*i)->done()) {
-					// Done. Remove it.
-					*i = curr->next;
-					curr->sema.up();
-				} else {
-					// Skip ahead.
-					i = &curr->next;
-				}
-			}
+			if (i != alive.end()) {
+				p = i->second;
+				alive.erase(i);
+				p->release();
+				releaseTokens();
 
-			// If we're done, we might need to hand over to someone else.
-			if (cond.done()) {
-				if (waiters) {
-					// Pick the first one, and wake it. It will become the new master since it is
-					// not done.
-					waiters->manager = true;
-					waiters->sema.up();
-				}
-
-				return;
-			} else {
-				// We removed ourselves earlier, add us back to the list.
-				cond.next = waiters;
-				waiters = &cond;
+				if (throttle)
+					procLimit = throttle->completed();
 			}
 		}
+
+		if (p) {
+			// Processes without an owner may be deleted by the thread in 'wait' as soon as
+			// 'terminated' returns.
+			ProcGroup *owner = p->owner;
+			p->terminated(result, stats);
+
+			if (owner)
+				owner->terminated(p, result, stats);
+		}
+	}
+
+	notifyWaiters();
+}
+
+/**
+ * Waits for a process that is not watched by OutputMgr. Each such process gets a thread of its own,
+ * so that we only wait for processes that nobody else waits for. This is usually not needed, since
+ * OutputMgr watches most processes.
+ */
+class Reaper : NoCopy {
+public:
+	Reaper(ProcId proc) : proc(proc) {}
+
+	// Process to wait for.
+	ProcId proc;
+
+	// Wait for the process, and delete ourselves.
+	void run() {
+		int result;
+		ProcStats stats;
+		if (systemWaitProc(proc, result, stats))
+			procExited(proc, result, stats);
+		delete this;
 	}
+};
+
+// Start a thread that waits for 'proc', which was just added to 'alive'.
+static void reapLater(ProcId proc) {
+	Reaper *reaper = new Reaper(proc);
+
+	// Note: The thread keeps running after 'thread' is destroyed.
+	Thread thread;
+	thread.start(&Reaper::run, *reaper);
+}
+
+ProcessCallback::~ProcessCallback() {}
+
+class WaitCond {
+public:
+	virtual ~WaitCond() {}
+
+	// Are we done? Called with 'waitLock' held.
+	virtual bool done() = 0;
+};
+
+// Wait until 'cond' returns true. The condition is evaluated again whenever a process terminated.
+void waitFor(WaitCond &cond) {
+	Lock::Guard z(waitLock);
+	while (!cond.done())
+		waitCond.wait(waitLock);
 }
 
 
 Process::Process(const Path &file, const vector<String> &args, const Path &cwd, const Env *env, nat skipLines) :
-	callback(null), file(file), args(args), cwd(cwd), env(env ? env->data() : null), skipLines(skipLines),
-	process(invalidProc), owner(null), outPipe(noPipe), errPipe(noPipe), result(0), finished(false) {}
+	callback(null), expectedMemory(0), remote(null), file(file), args(args), cwd(cwd), env(env ? env->data() : null),
+	skipLines(skipLines), process(invalidProc), owner(null), outPipe(noPipe), errPipe(noPipe), result(0),
+	reservedMemory(0), worker(-1), workerReserved(false), retries(0), oomKills(0), killed(false), block(null), finished(false) {}
+
+String Process::command() const {
+	ostringstream out;
+	out << file;
+	for (nat i = 0; i < args.size(); i++)
+		out << ' ' << args[i];
+	return out.str();
+}
+
+void Process::release() {
+	memoryReserved -= reservedMemory;
+	reservedMemory = 0;
+
+	if (workerReserved) {
+		workers[worker].running--;
+		remoteRunning--;
+		workerReserved = false;
+	}
+}
+
+Process *Process::restart() {
+	Process *p = new Process(file, args, cwd, null, skipLines);
+	p->env = env;
+	p->expectedMemory = expectedMemory;
+	p->retries = retries + 1;
+	p->callback = callback;
+	callback = null;
+	if (remote)
+		p->remote = new RemoteJob(*remote);
+	return p;
+}
 
 int Process::wait() {
 	class Finished : public WaitCond {
@@ -166,16 +270,27 @@ int Process::wait() {
 	return result;
 }
 
-void Process::terminated(int result) {
+void Process::terminated(int result, const ProcStats &stats) {
+	// Output from processes we killed is only noise after the output of the one that failed.
+	if (block) {
+		if (killed)
+			block->discard();
+		block->exited(result);
+	}
+
+	// Check the callback.
+	if (callback) {
+		ProcStats s = stats;
+		s.wallTime = Timestamp() - started;
+		callback->exited(result, s);
+	}
+
+	// Mark the process as finished last: 'wait' may return and delete us as soon as we do.
 	{
 		Lock::Guard z(finishLock);
 		this->result = result;
 		this->finished = true;
 	}
-
-	// Check the callback.
-	if (callback)
-		callback->exited(result);
 }
 
 #ifdef WINDOWS
@@ -183,6 +298,8 @@ void Process::terminated(int result) {
 const ProcId invalidProc = INVALID_HANDLE_VALUE;
 
 bool Process::spawn(bool manage, OutputState *state) {
+	started = Timestamp();
+
 	ostringstream cmdline;
 	cmdline << file;
 	for (nat i = 0; i < args.size(); i++)
@@ -198,17 +315,20 @@ bool Process::spawn(bool manage, OutputState *state) {
 	si.dwFlags |= STARTF_USESTDHANDLES;
 
 	if (manage) {
+		if (OutputBlock::enabled())
+			block = new OutputBlock(state, cmdline.str());
+
 		Pipe readStderr, writeStderr;
 		createPipe(readStderr, writeStderr, true);
 		si.hStdError = writeStderr;
 		errPipe = readStderr;
-		OutputMgr::addError(readStderr, state);
+		OutputMgr::addError(readStderr, state, 0, block);
 
 		Pipe readStdout, writeStdout;
 		createPipe(readStdout, writeStdout, true);
 		si.hStdOutput = writeStdout;
 		outPipe = readStdout;
-		OutputMgr::add(readStdout, state, skipLines);
+		OutputMgr::add(readStdout, state, skipLines, block);
 	} else {
 		si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
 		si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -246,7 +366,14 @@ bool Process::spawn(bool manage, OutputState *state) {
 	{
 		Lock::Guard z(aliveLock);
 		alive.insert(make_pair(process, this));
-		systemNewProc();
+		if (!systemNewProc(process, outPipe, errPipe))
+			reapLater(process);
+
+		// Everything may have been cancelled while we were starting.
+		if (owner && cancelled) {
+			killed = true;
+			systemCancel(vector<ProcId>(1, process));
+		}
 	}
 
 	// Start the process!
@@ -266,6 +393,8 @@ Process::~Process() {
 		{
 			Lock::Guard z(aliveLock);
 			alive.erase(process);
+			release();
+			releaseTokens();
 		}
 		CloseHandle(process);
 
@@ -276,7 +405,10 @@ Process::~Process() {
 			OutputMgr::remove(errPipe);
 	}
 
+	if (block)
+		block->unref();
 	delete callback;
+	delete remote;
 }
 
 static String getEnv(const char *name) {
@@ -311,74 +443,81 @@ Process *shellProcess(const String &command, const Path &cwd, const Env *env, na
 	return new Process(comSpecPath, args, cwd, env, skip);
 }
 
-// Event notified whenever we have a new process that we want to wait for. Used to cause the systemWaitProc to restart.
-static HANDLE selfEvent = NULL;
-
-static void systemNewProc() {
-	Lock::Guard z(aliveLock);
-
-	if (!selfEvent)
-		return;
-
-	SetEvent(selfEvent);
+static bool systemNewProc(ProcId, Pipe, Pipe) {
+	return false;
 }
 
-static bool systemWaitProc(ProcId &proc, int &code) {
-	nat size = 0;
-	ProcId *ids = null;
-
-	{
-		Lock::Guard z(aliveLock);
+static bool systemWaitProc(ProcId proc, int &code, ProcStats &stats) {
+	if (WaitForSingleObject(proc, INFINITE) != WAIT_OBJECT_0) {
+		WARNING("Failed to call WaitForSingleObject while waiting: " << GetLastError());
+		return false;
+	}
 
-		if (!selfEvent)
-			selfEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	DWORD c = 1;
+	GetExitCodeProcess(proc, &c);
+	code = int(c);
 
-		ids = new ProcId[1 + alive.size()];
-		ids[size++] = selfEvent;
-		for (ProcMap::const_iterator i = alive.begin(), end = alive.end(); i != end; ++i) {
-			if (!i->second->terminated()) {
-				ids[size++] = i->first;
-			}
-		}
+	// Note: These do not include processes started by 'proc'.
+	FILETIME created, exited, kernel, user;
+	if (GetProcessTimes(proc, &created, &exited, &kernel, &user)) {
+		// In units of 100 ns.
+		stats.userTime = Timespan::us(int64((nat64(user.dwHighDateTime) << 32 | user.dwLowDateTime) / 10));
+		stats.systemTime = Timespan::us(int64((nat64(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) / 10));
 	}
 
-	if (size <= 1) {
-		delete []ids;
-		return false;
+	IO_COUNTERS io;
+	if (GetProcessIoCounters(proc, &io)) {
+		stats.reads = io.ReadOperationCount;
+		stats.writes = io.WriteOperationCount;
 	}
 
-	DWORD result = WaitForMultipleObjects(size, ids, FALSE, INFINITE);
+	// Note: We do not measure the memory usage on Windows. It would require waiting for the entire
+	// job tree of the process.
+	return true;
+}
 
-	nat id = 0;
-	if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + size) {
-		id = result - WAIT_OBJECT_0;
-	} else if (result >= WAIT_ABANDONED_0 && result < WAIT_ABANDONED_0 + size) {
-		id = result - WAIT_ABANDONED_0;
-	} else {
-		WARNING("Failed to call WaitForMultipleObjects while waiting: " << GetLastError());
-		exit(10);
-	}
+static void systemFailFast() {}
 
-	if (id == 0) {
-		// It was the 'selfEvent'.
-		delete []ids;
-		return false;
-	}
+static void systemCancel(const vector<ProcId> &procs) {
+	// Note: This does not terminate processes started by the processes we started.
+	for (nat i = 0; i < procs.size(); i++)
+		TerminateProcess(procs[i], 1);
+}
 
-	proc = ids[id];
-	delete []ids;
+static nat64 systemAvailableMemory() {
+	MEMORYSTATUSEX status;
+	zeroMem(status);
+	status.dwLength = sizeof(status);
+	if (!GlobalMemoryStatusEx(&status))
+		return 0;
+	return status.ullAvailPhys;
+}
 
-	DWORD c = 1;
-	GetExitCodeProcess(proc, &c);
-	code = int(c);
-	return true;
+static nat64 systemOomKills() {
+	return 0;
+}
+
+static bool systemOutOfMemory(int, nat64) {
+	// Windows does not kill processes when it runs out of memory.
+	return false;
 }
 
 #else
 
 #include <cstring>
+#include <cerrno>
 #include <unistd.h>
+#include <spawn.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Do we have 'posix_spawn_file_actions_addchdir_np'? It is available in glibc 2.29 and later. If
+// it is not available, we use 'vfork' instead, which gives the same benefits but is less portable.
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define SPAWN_CHDIR
+#endif
 
 const ProcId invalidProc = 0;
 
@@ -388,7 +527,164 @@ static char *createStr(const String &str) {
 	return n;
 }
 
+// Process group for processes started by ProcGroup in fail-fast mode, so that terminating the
+// group also terminates any processes they started (e.g. the compiler started by a shell). Zero if
+// there is no such group. Protected by 'aliveLock', but also read by 'forwardSignal'.
+static volatile pid_t childGroup = 0;
+
+// Time processes get to exit after SIGTERM before we send SIGKILL, in seconds.
+static const nat killDelay = 2;
+
+// Thread sending SIGKILL to 'killGroup' after 'killDelay'.
+static Thread killer;
+static pid_t killGroup = 0;
+
+static void killerMain() {
+	sleep(killDelay);
+
+	// Note: Even if all processes we started have exited, processes they started may still be
+	// running in the group. However, if the group is empty, its id may have been reused by another
+	// group. A process we have not yet removed from 'alive' keeps the group alive, since its id is
+	// not reused until we have reaped it.
+	Lock::Guard z(aliveLock);
+	if (alive.empty() || childGroup != killGroup)
+		return;
+	if (kill(-killGroup, 0) == 0)
+		kill(-killGroup, SIGKILL);
+}
+
+// Processes in 'childGroup' are not in the foreground process group, so they do not get signals
+// from the terminal (e.g. Ctrl+C). Forward them before we terminate.
+static void forwardSignal(int sig) {
+	pid_t group = childGroup;
+	if (group > 0)
+		kill(-group, sig);
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+// Forward stop signals from the terminal (Ctrl+Z), and resume the group when we are resumed.
+static void forwardStop(int sig) {
+	pid_t group = childGroup;
+	if (group > 0)
+		kill(-group, SIGSTOP);
+
+	// The signal is blocked while we are in the handler. Unblock it so that we stop here.
+	signal(sig, SIG_DFL);
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, sig);
+	sigprocmask(SIG_UNBLOCK, &set, null);
+	raise(sig);
+
+	// We were resumed.
+	signal(sig, &forwardStop);
+	if (group > 0)
+		kill(-group, SIGCONT);
+}
+
+// Install 'handler' for 'sig', unless it was ignored when we started (e.g. by nohup).
+static void forward(int sig, void (*handler)(int)) {
+	if (signal(sig, handler) == SIG_IGN)
+		signal(sig, SIG_IGN);
+}
+
+static void systemFailFast() {
+	int signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+	for (nat i = 0; i < ARRAY_COUNT(signals); i++)
+		forward(signals[i], &forwardSignal);
+
+	forward(SIGTSTP, &forwardStop);
+}
+
+static void systemCancel(const vector<ProcId> &) {
+	// All processes with 'killed' set are in 'childGroup'.
+	if (childGroup > 0) {
+		kill(-childGroup, SIGTERM);
+		if (killGroup == 0) {
+			killGroup = childGroup;
+			killer.start(&killerMain);
+		}
+	}
+}
+
+// Start a child process without copying our address space. Redirects stdout and stderr to 'out'
+// and 'err' unless they are 'noPipe'. If 'group' is zero, the child is placed in a new process
+// group, if it is positive, the child joins that group. Returns 0 on success, and an error code
+// otherwise.
+static int systemSpawn(pid_t &child, char **argv, char **envp, const char *cwd, Pipe out, Pipe err, pid_t group) {
+#ifdef SPAWN_CHDIR
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	if (group >= 0) {
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+		posix_spawnattr_setpgroup(&attr, group);
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+
+	posix_spawn_file_actions_addchdir_np(&actions, cwd);
+
+	// Note: The pipes are created with O_CLOEXEC, so the original fds are closed in the child
+	// automatically. dup2 clears the flag on the new fd.
+	if (out != noPipe)
+		posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+	if (err != noPipe)
+		posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+
+	int result = posix_spawn(&child, argv[0], &actions, &attr, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	return result;
+
+#else
+
+	// The child shares our memory until it calls 'exec', so it reports errors by writing here.
+	volatile int error = 0;
+
+	child = vfork();
+	if (child == 0) {
+		// Note: We may only call async-signal-safe functions here.
+		if (group >= 0 && setpgid(0, group)) {
+			error = errno;
+			_exit(127);
+		}
+
+		if (chdir(cwd)) {
+			error = errno;
+			_exit(127);
+		}
+
+		if (out != noPipe)
+			dup2(out, STDOUT_FILENO);
+		if (err != noPipe)
+			dup2(err, STDERR_FILENO);
+
+		execve(argv[0], argv, envp);
+		error = errno;
+		_exit(127);
+	} else if (child < 0) {
+		return errno;
+	}
+
+	if (error) {
+		// Reap the child, nobody else will.
+		int status;
+		waitpid(child, &status, 0);
+		return error;
+	}
+
+	return 0;
+
+#endif
+}
+
 bool Process::spawn(bool manage, OutputState *state) {
+	started = Timestamp();
+
 	nat argc = args.size() + 1;
 	char **argv = new char *[argc + 1];
 
@@ -400,83 +696,67 @@ bool Process::spawn(bool manage, OutputState *state) {
 
 	argv[argc] = null;
 
-	Pipe writeStderr, writeStdout;
+	Pipe writeStderr = noPipe, writeStdout = noPipe;
 	if (manage) {
+		if (OutputBlock::enabled())
+			block = new OutputBlock(state, command());
+
 		Pipe readStderr, readStdout;
 		// Don't create shareable handles, we dup2() them anyway:
 		createPipe(readStderr, writeStderr, false);
 		errPipe = readStderr;
-		OutputMgr::addError(readStderr, state);
+		OutputMgr::addError(readStderr, state, 0, block);
 
 		// Don't create shareable handles, we dup2() them anyway:
 		createPipe(readStdout, writeStdout, false);
 		outPipe = readStdout;
-		OutputMgr::add(readStdout, state, skipLines);
+		OutputMgr::add(readStdout, state, skipLines, block);
 	}
 
 	// Prepare everything so we do not have to do potential mallocs in the child.
 	String wdStr = toS(cwd);
-	const char *wdCStr = wdStr.c_str();
+	oomKills = systemOomKills();
+	char **envp = env ? (char **)env : environ;
 
-	sigset_t waitFor;
-	sigemptyset(&waitFor);
-	sigaddset(&waitFor, SIGCONT);
+	int error;
+	{
+		// Hold 'aliveLock' until the child is in 'alive'. Otherwise, a reaper thread could reap the
+		// child before we know about it. It will not look it up until we release the lock.
+		Lock::Guard z(aliveLock);
 
-	// Make sure we do not consume SIGCONT too early in the child.
-	sigset_t oldMask;
-	pthread_sigmask(SIG_BLOCK, &waitFor, &oldMask);
+		// In fail-fast mode, processes from ProcGroup are placed in a group of their own.
+		pid_t group = -1;
+		if (manage && failFast) {
+			if (alive.empty())
+				childGroup = 0;
+			group = childGroup;
+		}
 
-	pid_t child = fork();
-	if (child == 0) {
-		if (chdir(wdCStr)) {
-			perror("Failed to chdir: ");
-			exit(1);
+		pid_t child = invalidProc;
+		error = systemSpawn(child, argv, envp, wdStr.c_str(), writeStdout, writeStderr, group);
+		if (error == EPERM && group > 0) {
+			// All processes in the group have exited, but some are not yet removed from 'alive'.
+			group = 0;
+			error = systemSpawn(child, argv, envp, wdStr.c_str(), writeStdout, writeStderr, group);
 		}
 
-		// Redirect stderr/stdout.
-		if (manage) {
-			close(STDERR_FILENO);
-			dup2(writeStderr, STDERR_FILENO);
-			close(writeStderr);
+		if (error == 0) {
+			process = child;
+			if (group == 0)
+				childGroup = child;
 
-			close(STDOUT_FILENO);
-			dup2(writeStdout, STDOUT_FILENO);
-			close(writeStdout);
-		}
+			alive.insert(make_pair(process, this));
+			if (!systemNewProc(process, outPipe, errPipe))
+				reapLater(process);
 
-		// Wait until our parent is ready...
-		int signal;
-		do {
-			if (sigwait(&waitFor, &signal)) {
-				perror("Sigwait: ");
-				exit(4);
+			// Everything may have been cancelled while we were starting.
+			if (owner && cancelled) {
+				killed = true;
+				systemCancel(vector<ProcId>(1, process));
 			}
-		} while (signal != SIGCONT);
-
-		if (env) {
-			execve(argv[0], argv, (char **)env);
-		} else {
-			execv(argv[0], argv);
 		}
-
-		perror("Failed to exec: ");
-		exit(1);
-	}
-
-	// Restore mask.
-	pthread_sigmask(SIG_SETMASK, &oldMask, null);
-
-	process = child;
-
-	{
-		Lock::Guard z(aliveLock);
-		alive.insert(make_pair(process, this));
-		systemNewProc();
 	}
 
-	// Start child again.
-	kill(child, SIGCONT);
-
 	if (manage) {
 		// Close our ends of the pipes.
 		closePipe(writeStderr);
@@ -489,6 +769,17 @@ bool Process::spawn(bool manage, OutputState *state) {
 	}
 	delete []argv;
 
+	if (error) {
+		WARNING("Failed to launch " << file << ": " << strerror(error));
+		process = invalidProc;
+
+		if (manage) {
+			OutputMgr::remove(errPipe);
+			OutputMgr::remove(outPipe);
+		}
+		return false;
+	}
+
 	return true;
 }
 
@@ -499,6 +790,8 @@ Process::~Process() {
 		{
 			Lock::Guard z(aliveLock);
 			alive.erase(process);
+			release();
+			releaseTokens();
 		}
 
 		if (outPipe != noPipe)
@@ -508,7 +801,10 @@ Process::~Process() {
 			OutputMgr::remove(errPipe);
 	}
 
+	if (block)
+		block->unref();
 	delete callback;
+	delete remote;
 }
 
 Process *shellProcess(const String &command, const Path &cwd, const Env *env, nat skip) {
@@ -519,35 +815,167 @@ Process *shellProcess(const String &command, const Path &cwd, const Env *env, na
 	return new Process(Path("/bin/sh"), args, cwd, env, skip);
 }
 
-static void systemNewProc() {
-	// Not needed on Linux, waitpid will catch the new child anyway.
+// Open a pidfd for 'pid'. Available in Linux 5.3 and later.
+static int pidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return int(syscall(SYS_pidfd_open, pid, 0));
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
 }
 
-static bool systemWaitProc(ProcId &proc, int &result) {
-	{
-		Lock::Guard z(aliveLock);
-		if (alive.empty())
-			return false;
+// Get the result of a process from 'status'. Returns false if it has not terminated.
+static bool exitResult(int status, int &result) {
+	if (WIFEXITED(status)) {
+		result = WEXITSTATUS(status);
+	} else if (WIFSIGNALED(status)) {
+		result = -WTERMSIG(status);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Convert a timeval to a Timespan.
+static Timespan toSpan(const timeval &t) {
+	return Timespan::us(int64(t.tv_sec) * 1000000 + t.tv_usec);
+}
+
+// Get statistics from 'usage'.
+static void usageStats(const rusage &usage, ProcStats &stats) {
+	// Note: This includes the peak of any children of the process that it waited for, which is
+	// what we want for processes started through a shell. The same goes for the other values.
+	stats.peakMemory = nat64(usage.ru_maxrss) * 1024;
+	stats.userTime = toSpan(usage.ru_utime);
+	stats.systemTime = toSpan(usage.ru_stime);
+	stats.reads = nat64(usage.ru_inblock);
+	stats.writes = nat64(usage.ru_oublock);
+}
+
+/**
+ * Reaps a process when its pidfd is signaled.
+ */
+class ReapProc : public HandleWatch {
+public:
+	ReapProc(pid_t pid) : pid(pid) {}
+
+	// Process.
+	pid_t pid;
+
+	virtual void signaled() {
+		int status;
+		rusage usage;
+		pid_t r;
+		do {
+			r = wait4(pid, &status, WNOHANG, &usage);
+		} while (r < 0 && errno == EINTR);
+
+		int result;
+		if (r != pid || !exitResult(status, result))
+			return;
+
+		ProcStats stats;
+		usageStats(usage, stats);
+		procExited(pid, result, stats);
+	}
+};
+
+static bool systemNewProc(ProcId proc, Pipe out, Pipe err) {
+	// This way, the termination of the process is noticed by OutputMgr after it has forwarded the
+	// output of the process, without an extra thread.
+	int fd = pidfdOpen(proc);
+	if (fd < 0)
+		return false;
+
+	HandleWatch *watch = new ReapProc(proc);
+	if (!OutputMgr::watch(fd, watch, out, err)) {
+		delete watch;
+		close(fd);
+		return false;
 	}
 
+	return true;
+}
+
+static bool systemWaitProc(ProcId proc, int &result, ProcStats &stats) {
 	while (true) {
 		int status;
-		proc = waitpid(-1, &status, 0);
-		if (proc < 0) {
-			perror("waitpid: ");
-			continue;
+		rusage usage;
+		pid_t r = wait4(proc, &status, 0, &usage);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("wait4: ");
+			return false;
 		}
 
-		if (WIFEXITED(status)) {
-			result = WEXITSTATUS(status);
-			break;
-		} else if (WIFSIGNALED(status)) {
-			result = -WTERMSIG(status);
-			break;
-		}
+		if (!exitResult(status, result))
+			continue;
+
+		usageStats(usage, stats);
+		return true;
 	}
+}
 
-	return true;
+static nat64 systemAvailableMemory() {
+	// MemAvailable is a better estimate than the free memory, since it includes caches that can be
+	// dropped. It is not available in old kernels.
+	ifstream src("/proc/meminfo");
+	String line;
+	while (getline(src, line)) {
+		if (line.compare(0, 13, "MemAvailable:") == 0)
+			return to<nat64>(line.substr(13), 0) * 1024;
+	}
+
+	long pages = sysconf(_SC_AVPHYS_PAGES);
+	long size = sysconf(_SC_PAGESIZE);
+	if (pages < 0 || size < 0)
+		return 0;
+	return nat64(pages) * nat64(size);
+}
+
+// Find the file containing the memory events of our cgroup. Only cgroup v2 is supported.
+static String findOomEvents() {
+	ifstream src("/proc/self/cgroup");
+	String line;
+	while (getline(src, line)) {
+		if (line.compare(0, 3, "0::") == 0)
+			return "/sys/fs/cgroup" + line.substr(3) + "/memory.events";
+	}
+	return "";
+}
+
+static nat64 systemOomKills() {
+	static const String file = findOomEvents();
+	if (file.empty())
+		return 0;
+
+	// Note: We do not use the system-wide counter in /proc/vmstat, since processes that are killed
+	// elsewhere on the system would then cause us to reduce the number of processes. The counter in
+	// memory.events includes processes in child cgroups, and processes killed by the system-wide
+	// OOM killer (Linux 4.19 and later).
+	ifstream src(file.c_str());
+	String line;
+	while (getline(src, line)) {
+		if (line.compare(0, 9, "oom_kill ") == 0)
+			return to<nat64>(line.substr(9), 0);
+	}
+	return 0;
+}
+
+static bool systemOutOfMemory(int result, nat64 oomKills) {
+	// The OOM killer uses SIGKILL. We only send it to processes we cancelled, and those are not
+	// started again (see 'ProcGroup::terminated').
+	if (result == -SIGKILL)
+		return true;
+
+	// Usually, the process that is killed is a child of the process we started (e.g. 'cc1plus'
+	// started by 'g++', or anything started through a shell), which then exits with an error code.
+	// If the system killed a process in our cgroup while it was running, assume that was the cause.
+	// If the counter is not available, we only rely on SIGKILL above.
+	return result != 0 && systemOomKills() > oomKills;
 }
 
 #endif
@@ -556,7 +984,8 @@ static bool systemWaitProc(ProcId &proc, int &result) {
 ProcGroup::ProcGroup(nat limit, OutputState *state)
 	: state(state->ref()),
 	  limit(limit == 0 ? 1 : limit),
-	  failed(false) {}
+	  failed(false),
+	  remote(0) {}
 
 ProcGroup::~ProcGroup() {
 
@@ -580,25 +1009,184 @@ ProcGroup::~ProcGroup() {
 	Lock::Guard w(dataLock);
 	for (set<Process *>::iterator i = our.begin(), end = our.end(); i != end; ++i) {
 		alive.erase((*i)->process);
+		(*i)->release();
 		delete *i;
 	}
+	releaseTokens();
+
+	for (nat i = 0; i < retry.size(); i++)
+		delete retry[i];
 
 	state->unref();
 }
 
+// Is the global limit fixed to one process? An adaptive limit that reaches one does not count, since
+// it may increase again.
+static bool singleProcess() {
+	Lock::Guard z(aliveLock);
+	return throttle == null && procLimit == 1;
+}
+
 void ProcGroup::setLimit(nat l) {
+	Lock::Guard z(aliveLock);
+	delete throttle;
+	throttle = null;
+
 	if (l >= 1)
 		procLimit = l;
 }
 
-bool ProcGroup::canSpawn() {
+void ProcGroup::setAdaptive(nat floor, nat ceiling) {
+	Lock::Guard z(aliveLock);
+	delete throttle;
+	throttle = new Throttle(floor, ceiling);
+	procLimit = throttle->limit();
+}
+
+void ProcGroup::setMemoryLimit(bool enabled, nat64 bytes) {
+	Lock::Guard z(aliveLock);
+	memoryLimited = enabled;
+	memoryAuto = bytes == 0;
+	memoryBudget = memoryAuto ? systemAvailableMemory() : bytes;
+
+	// If we can not find the available memory, don't limit anything.
+	if (memoryBudget == 0)
+		memoryLimited = false;
+
+	if (memoryLimited)
+		DEBUG("Limiting memory usage to " << (memoryBudget >> 20) << " MiB.", VERBOSE);
+}
+
+void ProcGroup::cancelAll() {
+	Lock::Guard z(aliveLock);
+	if (!failFast || cancelled)
+		return;
+
+	cancelled = true;
+	vector<ProcId> procs;
+	for (ProcMap::const_iterator i = alive.begin(), end = alive.end(); i != end; ++i) {
+		if (i->second->owner) {
+			i->second->killed = true;
+			procs << i->first;
+		}
+	}
+	systemCancel(procs);
+}
+
+void ProcGroup::setFailFast(bool enabled) {
+	Lock::Guard z(aliveLock);
+	if (enabled && !failFast)
+		systemFailFast();
+	failFast = enabled;
+}
+
+void ProcGroup::addWorker(const String &address, nat slots) {
+	Lock::Guard z(aliveLock);
+	workers.push_back(RemoteWorker(address, slots));
+	DEBUG("Using the worker " << address << " with " << slots << " slots.", INFO);
+}
+
+// Check if a process expected to use 'expected' bytes fits in memory when 'running' processes are
+// running locally. Assumes 'aliveLock' is held.
+static bool fitsMemory(nat64 expected, nat running) {
+	if (!memoryLimited)
+		return true;
+
+	if (running == 0) {
+		// Always start one process, so that we make progress even if it seems like it will not
+		// fit. This is also a good time to check how much memory is available, since none of it is
+		// used by us.
+		if (memoryAuto) {
+			if (nat64 available = systemAvailableMemory())
+				memoryBudget = available;
+		}
+		return true;
+	}
+
+	return memoryReserved + expected <= memoryBudget;
+}
+
+// Pick a worker for a process, or return -1 to execute it locally. 'localFree' is true if the
+// process can be started locally, and 'running' of the 'slots' local slots are used. Assumes
+// 'aliveLock' is held.
+static int pickWorker(bool localFree, nat running, nat slots) {
+	int best = -1;
+	for (nat i = 0; i < workers.size(); i++) {
+		const RemoteWorker &w = workers[i];
+		if (w.running >= w.slots)
+			continue;
+
+		// Compare (running + 1) / slots without division.
+		if (best < 0 || (w.running + 1) * workers[best].slots < (workers[best].running + 1) * w.slots)
+			best = int(i);
+	}
+
+	if (best >= 0 && localFree) {
+		// Prefer to run locally, unless the worker has a smaller fraction of its slots in use.
+		const RemoteWorker &w = workers[best];
+		if ((running + 1) * w.slots <= (w.running + 1) * slots)
+			best = -1;
+	}
+
+	return best;
+}
+
+bool ProcGroup::canSpawn(Process *p) {
 	Lock::Guard z(aliveLock);
 	Lock::Guard w(dataLock);
-	return alive.size() < procLimit && our.size() < limit;
+
+	nat running = localRunning();
+	nat maxRunning = procLimit;
+	if (oomLimit > 0 && oomLimit < maxRunning)
+		maxRunning = oomLimit;
+
+	bool localFree = running < maxRunning
+		&& our.size() - remote < limit
+		&& fitsMemory(p->expectedMemory, running);
+
+	int worker = -1;
+	if (p->remote)
+		worker = pickWorker(localFree, running, maxRunning);
+
+	if (worker >= 0) {
+		RemoteWorker &to = workers[worker];
+		to.running++;
+		remoteRunning++;
+		starting++;
+
+		p->worker = worker;
+		p->workerReserved = true;
+		submitCommand(*p->remote, to.address, p->file, p->args);
+		return true;
+	}
+
+	if (!localFree)
+		return false;
+
+	// The first process uses our implicit job slot. Any others need a token from the jobserver.
+	// If no token is available, we try again when the jobserver tells us to.
+	if (running > tokens) {
+		if (!JobServer::acquire(&notifyWaiters))
+			return false;
+		tokens++;
+	}
+
+	starting++;
+	p->reservedMemory = p->expectedMemory;
+	memoryReserved += p->reservedMemory;
+	return true;
+}
+
+void ProcGroup::started(Process *p) {
+	Lock::Guard z(aliveLock);
+	starting--;
+	if (p->process == invalidProc)
+		p->release();
+	releaseTokens();
 }
 
 bool ProcGroup::spawn(Process *p) {
-	if (failed) {
+	if (failed || cancelled) {
 		delete p;
 		return false;
 	}
@@ -608,22 +1196,31 @@ bool ProcGroup::spawn(Process *p) {
 	class CanSpawn : public WaitCond {
 	public:
 		ProcGroup *me;
-		CanSpawn(ProcGroup *me) : me(me) {}
+		Process *p;
+		// Did we reserve a slot in 'canSpawn'?
+		bool reserved;
+		CanSpawn(ProcGroup *me, Process *p) : me(me), p(p), reserved(false) {}
 		virtual bool done() {
 			{
 				// Note: "canSpawn" takes the same lock, but in a different order!
 				Lock::Guard z(me->dataLock);
-				if (me->failed)
+				if (me->failed || cancelled)
 					return true;
 			}
-			return me->canSpawn();
+			return reserved = me->canSpawn(p);
 		}
 	};
 
-	CanSpawn c(this);
+	CanSpawn c(this, p);
+	Timestamp waitStart;
 	waitFor(c);
+	BuildStats::blocked(Timestamp() - waitStart);
 
-	if (failed) {
+	if (failed || cancelled) {
+		if (c.reserved) {
+			started(p);
+			notifyWaiters();
+		}
 		delete p;
 		return false;
 	}
@@ -631,15 +1228,27 @@ bool ProcGroup::spawn(Process *p) {
 	{
 		Lock::Guard z(dataLock);
 		our.insert(p);
+		if (p->worker >= 0)
+			remote++;
 	}
-	if (!p->spawn(true, state)) {
-		Lock::Guard z(dataLock);
-		our.erase(p);
+	bool ok = p->spawn(true, state);
+	started(p);
+	if (!ok) {
+		{
+			Lock::Guard z(dataLock);
+			our.erase(p);
+			if (p->worker >= 0)
+				remote--;
+		}
+		delete p;
+
+		// The slot we reserved is free again.
+		notifyWaiters();
 		return false;
 	}
 
 	// Make the output look more logical to the user when running on one thread.
-	if (limit == 1 || procLimit == 1) {
+	if ((limit == 1 || singleProcess()) && workers.empty()) {
 		return wait();
 	}
 
@@ -653,31 +1262,87 @@ bool ProcGroup::wait() {
 		Failed(ProcGroup *me) : me(me) {}
 		virtual bool done() {
 			Lock::Guard z(me->dataLock);
-			return me->failed || me->our.empty();
+			return me->failed || me->our.empty() || !me->retry.empty();
 		}
 	};
 
-	Failed c(this);
-	waitFor(c);
+	while (true) {
+		Failed c(this);
+		waitFor(c);
+
+		Process *p = null;
+		{
+			Lock::Guard z(dataLock);
+			if (failed || retry.empty())
+				return !failed;
 
-	Lock::Guard z(dataLock);
-	return !failed;
+			p = retry.back();
+			retry.pop_back();
+		}
+
+		if (!spawn(p))
+			return false;
+	}
 }
 
-void ProcGroup::terminated(Process *p, int result) {
+void ProcGroup::terminated(Process *p, int result, const ProcStats &stats) {
 	// Not our process?
 	{
 		Lock::Guard z(dataLock);
 		if (our.erase(p) == 0)
 			return;
+		if (p->worker >= 0)
+			remote--;
 	}
 
-	if (result != 0)
-		failed = true;
+	if (result != 0) {
+		// Processes we killed did not run out of memory, and shall not be started again.
+		Process *again = null;
+		if (!p->killed)
+			again = shouldRetry(p, result, stats);
+
+		if (again) {
+			Lock::Guard z(dataLock);
+			retry.push_back(again);
+		} else {
+			failed = true;
+			cancelAll();
+		}
+	}
 
 	delete p;
 }
 
+Process *ProcGroup::shouldRetry(Process *p, int result, const ProcStats &stats) {
+	// Note: Processes on workers are not affected by our memory.
+	if (p->worker >= 0 || p->retries >= maxRetries || !systemOutOfMemory(result, p->oomKills))
+		return null;
+
+	nat newLimit;
+	{
+		Lock::Guard z(aliveLock);
+
+		nat current = procLimit;
+		if (oomLimit > 0 && oomLimit < current)
+			current = oomLimit;
+
+		// If we were only running one process, it will not help to run it again.
+		if (current <= 1)
+			return null;
+
+		// Note: 'p' is not in 'alive' anymore.
+		nat running = min(current, localRunning() + 1);
+		newLimit = oomLimit = max(running / 2, nat(1));
+	}
+
+	WARNING("The process " << p->command() << " was killed, possibly because the system ran out of memory. "
+			<< "Restarting it with at most " << newLimit << " concurrent processes.");
+
+	Process *again = p->restart();
+	again->expectedMemory = max(again->expectedMemory, stats.peakMemory);
+	return again;
+}
+
 
 
 int exec(const Path &binary, const vector<String> &args, const Path &cwd, const Env *env) {
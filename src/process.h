@@ -2,6 +2,7 @@
 #include "env.h"
 #include "sync.h"
 #include "pipe.h"
+#include "worker.h"
 
 
 // Platform specific process handle.
@@ -14,6 +15,28 @@ typedef pid_t ProcId;
 extern const ProcId invalidProc;
 
 class ProcGroup;
+class OutputBlock;
+
+/**
+ * Resource usage of a terminated process.
+ */
+class ProcStats {
+public:
+	ProcStats() : peakMemory(0), reads(0), writes(0) {}
+
+	// Peak resident memory in bytes, including any children of the process. Zero if unknown.
+	nat64 peakMemory;
+
+	// CPU time spent in user mode and in the kernel, including any children of the process.
+	Timespan userTime, systemTime;
+
+	// Number of input and output operations that had to access the disk (on Windows, all I/O
+	// operations), including any children of the process.
+	nat64 reads, writes;
+
+	// Time from when the process was started until it terminated.
+	Timespan wallTime;
+};
 
 /**
  * Callback for process completion.
@@ -23,7 +46,7 @@ public:
 	virtual ~ProcessCallback();
 
 	// Called when the process is completed.
-	virtual void exited(int result) = 0;
+	virtual void exited(int result, const ProcStats &stats) = 0;
 };
 
 
@@ -52,6 +75,16 @@ public:
 	// Completion callback.
 	ProcessCallback *callback;
 
+	// Expected peak memory usage in bytes, or zero if unknown. Used by ProcGroup to avoid starting
+	// more processes than fit in memory.
+	nat64 expectedMemory;
+
+	// If set, ProcGroup may execute this process on a build worker instead (see worker.h). Owned.
+	RemoteJob *remote;
+
+	// Get the command line as a string, for messages.
+	String command() const;
+
 private:
 	// Parameters.
 	Path file;
@@ -74,6 +107,30 @@ private:
 	// Result.
 	int result;
 
+	// Memory reserved for this process by ProcGroup. Protected by 'aliveLock'.
+	nat64 reservedMemory;
+
+	// Worker this process is executed on, or -1 if it is executed locally.
+	int worker;
+
+	// Do we hold a slot on 'worker'? Protected by 'aliveLock'.
+	bool workerReserved;
+
+	// Number of times this process has been restarted.
+	nat retries;
+
+	// Number of processes killed by the system due to lack of memory when we were started.
+	nat64 oomKills;
+
+	// Did we kill the process when cancelling everything after a failure? Protected by 'aliveLock'.
+	bool killed;
+
+	// Output from the process, if it is collected into a block. Owns a reference.
+	OutputBlock *block;
+
+	// When the process was started.
+	Timestamp started;
+
 	// Finished? Locked.
 	bool finished;
 
@@ -81,9 +138,15 @@ private:
 	Lock finishLock;
 
 	// Called when the process terminated.
-	void terminated(int result);
+	void terminated(int result, const ProcStats &stats);
 
-	friend void waitProc();
+	// Create a copy of this process that can be started again. Moves the callback to the copy.
+	Process *restart();
+
+	// Release resources reserved by ProcGroup. Assumes 'aliveLock' is held.
+	void release();
+
+	friend void procExited(ProcId proc, int result, const ProcStats &stats);
 };
 
 
@@ -93,10 +156,24 @@ typedef map<ProcId, Process *> ProcMap;
 /**
  * Process group. Globally limits the number of live processes active through this class. Once one
  * process terminates with an error, the entire group will be put in a failure state.
+ *
+ * If a jobserver is active (see jobserver.h), a token is acquired from it for each process except
+ * the first one, so that the limit is shared with other processes using the same jobserver.
+ *
+ * If a memory limit is set, processes are also only started when the sum of their expected memory
+ * usage fits within the limit. A process that is killed in a way that indicates that the system ran
+ * out of memory is started again, with a lower global limit on the number of processes.
+ *
+ * In fail-fast mode, the first failure in any group terminates all processes in all groups, and no
+ * more processes are started. Processes we terminate this way are never started again.
+ *
+ * Processes that have 'remote' set may also be executed on build workers. Each worker has a number
+ * of slots in addition to the local limit, and processes are placed where the fraction of used
+ * slots is lowest. Processes on workers do not count towards the local limits.
  */
 class ProcGroup : NoCopy {
 public:
-	// Create, set local limit.
+	// Create, set local limit. The limit only applies to processes executed locally.
 	ProcGroup(nat limit, OutputState *state);
 
 	// Destroy.
@@ -105,6 +182,19 @@ public:
 	// Set the global limit.
 	static void setLimit(nat limit);
 
+	// Use an adaptive global limit between 'floor' and 'ceiling' (see throttle.h).
+	static void setAdaptive(nat floor, nat ceiling);
+
+	// Add a build worker with 'slots' slots.
+	static void addWorker(const String &address, nat slots);
+
+	// Terminate all processes as soon as one of them fails?
+	static void setFailFast(bool enabled);
+
+	// Set the global memory limit, in bytes. If 'bytes' is zero, the memory available in the system
+	// whenever no processes are running is used. If 'enabled' is false, memory usage is not limited.
+	static void setMemoryLimit(bool enabled, nat64 bytes);
+
 	// Spawn a new process when possible. Waits until we're below the global maximum number of
 	// processes before spawning a new process. Returns false if any previous process exited with
 	// an error.
@@ -130,14 +220,30 @@ private:
 	// Our processes.
 	set<Process *> our;
 
+	// Processes that shall be started again.
+	vector<Process *> retry;
+
+	// Number of processes in 'our' that are executed on workers.
+	nat remote;
+
 	// One of our processes has terminated!
-	void terminated(Process *p, int result);
+	void terminated(Process *p, int result, const ProcStats &stats);
+
+	// Terminate all processes started by any ProcGroup since one of them failed, if in fail-fast mode.
+	// Waiting threads are notified by 'procExited'.
+	static void cancelAll();
+
+	// Check if 'p' should be started again after terminating with 'result'. If so, returns a copy of it.
+	static Process *shouldRetry(Process *p, int result, const ProcStats &stats);
+
+	// Check if we can spawn 'p'. If so, a slot is reserved for it.
+	bool canSpawn(Process *p);
 
-	// Check if we can spawn a new process.
-	bool canSpawn();
+	// Called when a process reserved by 'canSpawn' has been started (or failed to start).
+	void started(Process *p);
 
 
-	friend void waitProc();
+	friend void procExited(ProcId proc, int result, const ProcStats &stats);
 };
 
 // Convenience functions.
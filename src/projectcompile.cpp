@@ -1,6 +1,6 @@
 #include "std.h"
 #include "projectcompile.h"
-#include "thread.h"
+#include "threadpool.h"
 #include "atomic.h"
 
 namespace compile {
@@ -9,7 +9,8 @@ namespace compile {
 		wd(wd),
 		projectFile(projectFile),
 		config(config),
-		showTimes(showTimes) {
+		showTimes(showTimes),
+		extCache(fileCache) {
 
 		{
 			set<String> s = cmdline;
@@ -38,6 +39,10 @@ namespace compile {
 		if (!config.getBool("parallel", true))
 			numThreads = 1;
 
+		buildDir = wd + Path(config.getVars("buildDir"));
+		buildDir.makeDir();
+		if (!force)
+			extCache.load(buildDir + "extcache");
 	}
 
 	Project::~Project() {
@@ -176,7 +181,7 @@ namespace compile {
 		Path dir = wd + name;
 		dir.makeDir();
 
-		if (!dir.exists()) {
+		if (!fileCache.exists(dir)) {
 			DEBUG(name << " is not a sub-project. The directory " << dir << " does not exist.", PEDANTIC);
 			return null;
 		}
@@ -192,7 +197,7 @@ namespace compile {
 		MakeConfig config;
 
 		Path configFile = dir + localConfig;
-		if (configFile.exists()) {
+		if (fileCache.exists(configFile)) {
 			DEBUG("Found local config: " << configFile, VERBOSE);
 			config.load(configFile);
 		} else if (explicitTargets) {
@@ -231,14 +236,14 @@ namespace compile {
 		opt.env = Env::update(this->config.env, opt);
 		DEBUG("Environment variables for " << name << ": " << opt.env, DEBUG);
 
-		return new Target(dir, opt);
+		return new Target(dir, opt, &fileCache, &extCache);
 	}
 
-	Project::FindState::FindState(Project *p) : project(p), threads(null) {
+	Project::FindState::FindState(Project *p) : project(p), tasks(null) {
 		if (project->numThreads > 1) {
-			threads = new Thread[p->numThreads];
+			tasks = new TaskGroup();
 			for (nat i = 0; i < project->numThreads; i++) {
-				threads[i].start(&FindState::main, *this);
+				tasks->spawn(&FindState::main, *this);
 			}
 		}
 	}
@@ -247,11 +252,8 @@ namespace compile {
 		// Failsafe.
 		work.done();
 
-		if (threads) {
-			for (nat i = 0; i < project->numThreads; i++)
-				threads[i].join();
-			delete []threads;
-		}
+		// Waits for the tasks.
+		delete tasks;
 	}
 
 	void Project::FindState::push(TargetInfo *info) {
@@ -294,7 +296,8 @@ namespace compile {
 
 		TargetInfo *t = found->second;
 
-		map<nat, LibDeps> d = dependencies(t);
+		map<nat, LibDeps> d;
+		dependencies(t, d);
 		for (map<nat, LibDeps>::reverse_iterator i = d.rbegin(), end = d.rend(); i != end; ++i) {
 			LibDeps &deps = i->second;
 
@@ -307,15 +310,12 @@ namespace compile {
 
 	}
 
-	map<nat, Project::LibDeps> Project::dependencies(const TargetInfo *root) const {
-		map<nat, LibDeps> output;
+	void Project::dependencies(const TargetInfo *root, map<nat, LibDeps> &output) const {
 		vector<bool> visited(order.size(), false);
 
 		visited[root->order] = true;
 
 		dependencies(root->name, visited, output, root);
-
-		return output;
 	}
 
 	static String libNames(const vector<Path> &local, const vector<String> &ext) {
@@ -389,6 +389,10 @@ namespace compile {
 			DEBUG("-- Target " << info.name << " --", NORMAL);
 			t->clean();
 		}
+
+		DEBUG("-- Project --", NORMAL);
+		DEBUG("Cleaning " << buildDir.makeRelative(wd) << "...", NORMAL);
+		buildDir.recursiveDelete();
 	}
 
 	bool Project::compile() {
@@ -445,15 +449,13 @@ namespace compile {
 	bool Project::compileMT(nat threadCount) {
 		MTCompileState state(*this);
 
-		Thread *threads = new Thread[threadCount];
+		TaskGroup tasks;
 		for (nat i = 0; i < threadCount; i++) {
-			threads[i].start(&MTCompileState::start, state);
+			tasks.spawn(&MTCompileState::start, state);
 		}
 
-		// Join all threads, and read result.
-		for (nat i = 0; i < threadCount; i++) {
-			threads[i].join();
-		}
+		// Wait for all tasks, and read result.
+		tasks.wait();
 
 		return atomicRead(state.ok) != 0;
 	}
@@ -527,10 +529,18 @@ namespace compile {
 	}
 
 	void Project::save() const {
+		bool built = false;
 		for (map<String, TargetInfo *>::const_iterator i = target.begin(); i != target.end(); ++i) {
-			if (i->second && i->second->target)
-				i->second->target->save();
+			if (i->second && i->second->target && i->second->target->save())
+				built = true;
 		}
+
+		// Note: Like the targets, we don't create the build directory unless something was built.
+		if (!built && !fileCache.exists(buildDir))
+			return;
+
+		buildDir.createDir();
+		extCache.save(buildDir + "extcache");
 	}
 
 	int Project::execute(const vector<String> &params) {
@@ -3,7 +3,7 @@
 #include "uniquequeue.h"
 #include "toposort.h"
 #include "sync.h"
-#include "thread.h"
+#include "threadpool.h"
 #include "workqueue.h"
 
 namespace compile {
@@ -34,6 +34,9 @@ namespace compile {
 		// Execute the resulting file.
 		int execute(const vector<String> &params);
 
+		// Metadata of files used by the project.
+		inline const FileCache &files() const { return fileCache; }
+
 	private:
 		// Working directory for the project.
 		Path wd;
@@ -65,6 +68,14 @@ namespace compile {
 		// Use prefix when building in parallel?
 		String usePrefix;
 
+		// Build directory for the project itself.
+		Path buildDir;
+
+		// Metadata of files and files in directories, shared between all targets. These are
+		// thread-safe, so it is fine to modify them from const members.
+		mutable FileCache fileCache;
+		mutable ExtCache extCache;
+
 		// Information about a target and all it dependencies.
 		typedef Node<String> TargetDeps;
 
@@ -139,7 +150,7 @@ namespace compile {
 			~FindState();
 
 			// Using multiple threads?
-			bool isMT() const { return threads != null; }
+			bool isMT() const { return tasks != null; }
 
 			// Push an element.
 			void push(TargetInfo *info);
@@ -156,8 +167,8 @@ namespace compile {
 			// Owner.
 			Project *project;
 
-			// Threads (if created).
-			Thread *threads;
+			// Tasks (if created).
+			TaskGroup *tasks;
 
 			// Work queue.
 			WorkQueue<TargetInfo> work;
@@ -195,8 +206,8 @@ namespace compile {
 			vector<String> external;
 		};
 
-		// Find dependencies to a target. Duplicates are removed. Returns order-id -> output file name.
-		map<nat, LibDeps> dependencies(const TargetInfo *info) const;
+		// Find dependencies to a target. Duplicates are removed. Adds order-id -> output file name to 'out'.
+		void dependencies(const TargetInfo *info, map<nat, LibDeps> &out) const;
 		void dependencies(const String &root, vector<bool> &visited, map<nat, LibDeps> &out, const TargetInfo *at) const;
 
 		// Compile one target. This function may only _read_ from shared data.
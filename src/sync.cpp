@@ -35,6 +35,24 @@ void Sema::down() {
 	WaitForSingleObject(sema, INFINITE);
 }
 
+CondVar::CondVar() {
+	InitializeConditionVariable(&cond);
+}
+
+CondVar::~CondVar() {}
+
+void CondVar::wait(Lock &lock) {
+	SleepConditionVariableCS(&cond, &lock.lock, INFINITE);
+}
+
+void CondVar::signal() {
+	WakeConditionVariable(&cond);
+}
+
+void CondVar::broadcast() {
+	WakeAllConditionVariable(&cond);
+}
+
 #else
 
 Lock::Lock() {
@@ -73,6 +91,26 @@ void Sema::down() {
 	sem_wait(&sema);
 }
 
+CondVar::CondVar() {
+	pthread_cond_init(&cond, NULL);
+}
+
+CondVar::~CondVar() {
+	pthread_cond_destroy(&cond);
+}
+
+void CondVar::wait(Lock &lock) {
+	pthread_cond_wait(&cond, &lock.lock);
+}
+
+void CondVar::signal() {
+	pthread_cond_signal(&cond);
+}
+
+void CondVar::broadcast() {
+	pthread_cond_broadcast(&cond);
+}
+
 #endif
 
 
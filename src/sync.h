@@ -31,6 +31,8 @@ private:
 #else
 	pthread_mutex_t lock;
 #endif
+
+	friend class CondVar;
 };
 
 
@@ -78,3 +80,34 @@ private:
 	// Semaphore for the waiting.
 	Sema sema;
 };
+
+
+/**
+ * Condition variable, used together with a Lock. Unlike Condition, it does not remember being
+ * signaled, so the state waited for needs to be checked while holding the lock.
+ */
+class CondVar : NoCopy {
+public:
+	// Create.
+	CondVar();
+
+	// Destroy.
+	~CondVar();
+
+	// Wait until signaled. 'lock' must be held exactly once by the current thread. It is released
+	// while waiting, and held again when we return. Spurious wakeups are possible.
+	void wait(Lock &lock);
+
+	// Wake one waiting thread.
+	void signal();
+
+	// Wake all waiting threads.
+	void broadcast();
+
+private:
+#ifdef WINDOWS
+	CONDITION_VARIABLE cond;
+#else
+	pthread_cond_t cond;
+#endif
+};
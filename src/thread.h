@@ -56,7 +56,7 @@ void Thread::start(void (*fn)(T &), T &data) {
 		T *data;
 
 		virtual void start() {
-			(*fn)(data);
+			(*fn)(*data);
 		}
 
 		D(void (*fn)(T &), T *data) : fn(fn), data(data) {}
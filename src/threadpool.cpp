@@ -0,0 +1,127 @@
+#include "std.h"
+#include "threadpool.h"
+
+/**
+ * The pool itself. Threads are never stopped, they wait for more tasks until the program exits.
+ */
+class ThreadPool : NoCopy {
+public:
+	// Add a task, starting a new thread if all threads are busy.
+	static void add(TaskGroup::Task *task);
+
+private:
+	/**
+	 * Data shared by the threads.
+	 */
+	class Data : NoCopy {
+	public:
+		Data() : idle(0) {}
+
+		// Lock for the members below.
+		Lock lock;
+
+		// Tasks not yet taken by a thread.
+		queue<TaskGroup::Task *> tasks;
+
+		// One 'up' for each task in 'tasks'.
+		Sema available;
+
+		// Number of threads that are not running a task, and are not about to take one.
+		nat idle;
+
+		// All threads.
+		vector<Thread *> threads;
+	};
+
+	// Get the data. Created on first use and intentionally never destroyed, since the threads keep
+	// waiting for it while static objects are destroyed at exit.
+	static Data &data();
+
+	// Main function for the threads.
+	static void main();
+};
+
+ThreadPool::Data &ThreadPool::data() {
+	static Data *d = new Data();
+	return *d;
+}
+
+void ThreadPool::add(TaskGroup::Task *task) {
+	Data &d = data();
+	nat started = 0;
+	{
+		Lock::Guard z(d.lock);
+		d.tasks.push(task);
+
+		// Reserve an idle thread for the task, or start a new one. Otherwise, a task could wait for
+		// a thread that is blocked waiting for the task.
+		if (d.idle > 0) {
+			d.idle--;
+		} else {
+			Thread *t = new Thread();
+			t->start(&ThreadPool::main);
+			d.threads << t;
+			started = d.threads.size();
+		}
+	}
+	d.available.up();
+
+	if (started)
+		DEBUG("Started thread " << started << " in the thread pool.", DEBUG);
+}
+
+void ThreadPool::main() {
+	Data &d = data();
+	while (true) {
+		d.available.down();
+
+		TaskGroup::Task *task;
+		{
+			Lock::Guard z(d.lock);
+			task = d.tasks.front();
+			d.tasks.pop();
+		}
+
+		TaskGroup *group = task->group;
+		task->run();
+		delete task;
+
+		{
+			Lock::Guard z(d.lock);
+			d.idle++;
+		}
+
+		// Note: 'group' may be destroyed as soon as this call releases its lock.
+		group->finished();
+	}
+}
+
+
+TaskGroup::Task::~Task() {}
+
+TaskGroup::TaskGroup() : pending(0) {}
+
+TaskGroup::~TaskGroup() {
+	wait();
+}
+
+void TaskGroup::rawSpawn(Task *task) {
+	task->group = this;
+	{
+		Lock::Guard z(lock);
+		pending++;
+	}
+	ThreadPool::add(task);
+}
+
+void TaskGroup::wait() {
+	Lock::Guard z(lock);
+	while (pending > 0)
+		done.wait(lock);
+}
+
+void TaskGroup::finished() {
+	Lock::Guard z(lock);
+	if (--pending == 0)
+		done.broadcast();
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "thread.h"
+#include "sync.h"
+
+/**
+ * A group of tasks, executed by a pool of threads shared by the entire program. Threads in the pool
+ * are kept when their tasks are done, so that later phases (e.g. compiling after finding
+ * dependencies, or the next prefetch) reuse them instead of starting and joining new threads.
+ *
+ * Tasks may block, for example while waiting for processes or for other tasks. Therefore, each task
+ * is given a thread of its own as soon as it is spawned: the pool starts a new thread whenever all
+ * of its threads are busy. Callers limit the number of tasks they spawn, just as they used to limit
+ * the number of threads they started.
+ */
+class TaskGroup : NoCopy {
+	friend class ThreadPool;
+public:
+	// Create an empty group.
+	TaskGroup();
+
+	// Waits for all tasks in the group.
+	~TaskGroup();
+
+	// Run 'fn' in a thread from the pool.
+	template <class T>
+	void spawn(void (*fn)(T &), T &data);
+
+	template <class T>
+	void spawn(void (T::*fn)(), T &data);
+
+	// Wait until all tasks spawned so far are done.
+	void wait();
+
+	// A task.
+	class Task : NoCopy {
+	public:
+		virtual ~Task();
+
+		// Run the task.
+		virtual void run() = 0;
+
+		// Group the task belongs to.
+		TaskGroup *group;
+	};
+
+private:
+	// Number of tasks not yet done.
+	nat pending;
+
+	// Lock for 'pending'.
+	Lock lock;
+
+	// Signaled when 'pending' reaches zero.
+	CondVar done;
+
+	// Hand a task to the pool.
+	void rawSpawn(Task *task);
+
+	// Called by the pool when a task in this group is done.
+	void finished();
+};
+
+
+// Implementation of template members.
+template <class T>
+void TaskGroup::spawn(void (*fn)(T &), T &data) {
+	class D : public Task {
+	public:
+		void (*fn)(T &);
+		T *data;
+
+		virtual void run() {
+			(*fn)(*data);
+		}
+
+		D(void (*fn)(T &), T *data) : fn(fn), data(data) {}
+	};
+
+	rawSpawn(new D(fn, &data));
+}
+
+template <class T>
+void TaskGroup::spawn(void (T::*fn)(), T &data) {
+	class D : public Task {
+	public:
+		void (T::*fn)();
+		T *data;
+
+		virtual void run() {
+			(data->*fn)();
+		}
+
+		D(void (T::*fn)(), T *data) : fn(fn), data(data) {}
+	};
+
+	rawSpawn(new D(fn, &data));
+}
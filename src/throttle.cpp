@@ -0,0 +1,153 @@
+#include "std.h"
+#include "throttle.h"
+
+// Minimum length of a measurement window.
+static const Timespan minWindow = Timespan::ms(2000);
+
+// Fraction of the CPUs used by others above which we back off quickly, if the machine is saturated.
+static const double maxOthers = 0.25;
+
+// Fraction of the CPUs our children need to use for us to consider the machine saturated.
+static const double saturated = 0.95;
+
+#ifdef WINDOWS
+
+static nat cpuCount() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+// Not implemented on Windows.
+static bool systemCpuTime(nat64 &, nat64 &) {
+	return false;
+}
+
+// Not available on Windows, since we don't wait for our children with a single call.
+static bool childCpuTime(nat64 &) {
+	return false;
+}
+
+#else
+
+#include <cstdio>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static nat cpuCount() {
+	long r = sysconf(_SC_NPROCESSORS_ONLN);
+	return r > 0 ? nat(r) : 1;
+}
+
+// Time spent by all CPUs in the system, busy and in total, from /proc/stat. The unit does not
+// matter, as only the ratio is used. Only available on Linux.
+static bool systemCpuTime(nat64 &busy, nat64 &total) {
+	FILE *f = fopen("/proc/stat", "r");
+	if (!f)
+		return false;
+
+	unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+	int r = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+				&user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+	fclose(f);
+	if (r < 4)
+		return false;
+
+	busy = user + nice + system + irq + softirq + steal;
+	total = busy + idle + iowait;
+	return true;
+}
+
+static bool childCpuTime(nat64 &out) {
+	rusage usage;
+	if (getrusage(RUSAGE_CHILDREN, &usage))
+		return false;
+
+	out = nat64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL;
+	out += usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	return true;
+}
+
+#endif
+
+Throttle::Throttle(nat floor, nat ceiling) :
+	floor(max(floor, nat(1))), ceiling(max(floor, ceiling)), current(0), cpus(cpuCount()),
+	direction(1), windowCpu(0), windowSystemBusy(0), windowSystemTotal(0), windowJobs(0), lastThroughput(-1) {
+
+	set(int(cpus));
+	childCpuTime(windowCpu);
+	systemCpuTime(windowSystemBusy, windowSystemTotal);
+	DEBUG("Adaptive process limit between " << this->floor << " and " << this->ceiling << ", starting at " << current, INFO);
+}
+
+nat Throttle::completed() {
+	windowJobs++;
+
+	// Make sure each window contains enough processes to say something about the throughput.
+	if (windowJobs >= current && Timestamp() - windowStart >= minWindow)
+		adjust();
+
+	return current;
+}
+
+void Throttle::adjust() {
+	Timestamp now;
+	double seconds = (now - windowStart).micros() / 1000000.0;
+	double throughput = windowJobs / seconds;
+
+	// Average number of CPUs used by our children during the window.
+	double busy = -1;
+	nat64 cpu = 0;
+	if (childCpuTime(cpu)) {
+		busy = (cpu - windowCpu) / 1000000.0 / seconds;
+		windowCpu = cpu;
+	}
+
+	// Average number of CPUs used by everyone during the window.
+	double used = -1;
+	nat64 systemBusy = 0, systemTotal = 0;
+	if (systemCpuTime(systemBusy, systemTotal)) {
+		if (systemTotal > windowSystemTotal)
+			used = double(systemBusy - windowSystemBusy) / (systemTotal - windowSystemTotal) * cpus;
+		windowSystemBusy = systemBusy;
+		windowSystemTotal = systemTotal;
+	}
+
+	// Number of CPUs used by others. Unknown if we don't know both.
+	double others = -1;
+	if (used >= 0 && busy >= 0)
+		others = max(used - busy, 0.0);
+
+	if (used >= cpus * saturated && others > cpus * maxOthers) {
+		// The machine is saturated, and a large part is used by others. Back off quickly to leave
+		// room for them.
+		set(int(current - max(current / 4, nat(1))));
+		direction = -1;
+	} else {
+		if (lastThroughput >= 0 && throughput < lastThroughput * 0.95) {
+			// Worse than before. Turn around.
+			direction = -direction;
+		}
+
+		// Don't increase if the CPUs are already saturated by us.
+		if (direction > 0 && busy >= cpus * saturated)
+			direction = -1;
+
+		set(int(current) + direction);
+	}
+
+	DEBUG("Throughput: " << throughput << " jobs/s, CPUs used: " << used << ", by us: " << busy
+		<< ". New process limit: " << current, VERBOSE);
+
+	lastThroughput = throughput;
+	windowStart = now;
+	windowJobs = 0;
+}
+
+void Throttle::set(int limit) {
+	if (limit < int(floor))
+		limit = int(floor);
+	if (limit > int(ceiling))
+		limit = int(ceiling);
+	current = nat(limit);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "timestamp.h"
+
+/**
+ * Adaptive limit for the number of concurrent processes.
+ *
+ * Adjusts the limit between a floor and a ceiling while the build is running. The limit is
+ * re-evaluated each time a sufficient number of processes have terminated. It is decreased quickly
+ * when all CPUs are busy and a large part of them is used by others (i.e. when other jobs compete
+ * for the machine), and it is not increased while our children already keep all CPUs busy. Both are
+ * measured over the same window: the CPU time of the system from /proc/stat, and the CPU time of
+ * our terminated children. Otherwise, the limit performs a hill-climb on the throughput, measured
+ * as completed processes per second: it keeps moving in the same direction as long as the
+ * throughput does not get worse, and turns around when it does.
+ *
+ * Not thread safe. ProcGroup only calls it while holding its lock.
+ */
+class Throttle : NoCopy {
+public:
+	// Create. The initial limit is the number of CPUs, clamped to the floor and ceiling.
+	Throttle(nat floor, nat ceiling);
+
+	// Current limit.
+	inline nat limit() const { return current; }
+
+	// Called when a process has terminated. Returns the new limit.
+	nat completed();
+
+private:
+	// Bounds.
+	nat floor, ceiling;
+
+	// Current limit.
+	nat current;
+
+	// Number of CPUs in the system.
+	nat cpus;
+
+	// Direction of the last change (+1 or -1).
+	int direction;
+
+	// Start of the current measurement window.
+	Timestamp windowStart;
+
+	// CPU time used by terminated children at the start of the window, in microseconds.
+	nat64 windowCpu;
+
+	// Busy and total CPU time of the system at the start of the window.
+	nat64 windowSystemBusy, windowSystemTotal;
+
+	// Number of processes completed in this window.
+	nat windowJobs;
+
+	// Throughput in the previous window (jobs per second). Negative if none.
+	double lastThroughput;
+
+	// Evaluate the current window and move the limit.
+	void adjust();
+
+	// Set a new limit, clamped to the bounds.
+	void set(int limit);
+};
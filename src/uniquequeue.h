@@ -47,7 +47,7 @@ public:
 
 private:
 	// Files in the queue.
-	hash_set<K> s;
+	FlatSet<K> s;
 
 	// Queue of files.
 	queue<V> q;
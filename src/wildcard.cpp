@@ -7,6 +7,13 @@ bool Wildcard::matches(const String &str) const {
 	return matches(0, str, 0);
 }
 
+bool Wildcard::matchesAllIn(const String &dir) const {
+	if (pattern.empty() || pattern[pattern.size() - 1] != '*')
+		return false;
+
+	return Wildcard(pattern.substr(0, pattern.size() - 1)).matches(dir);
+}
+
 bool Wildcard::matches(nat strAt, const String &str, nat patternAt) const {
 	for (; patternAt < pattern.length(); patternAt++) {
 		if (strAt == str.length())
@@ -12,6 +12,11 @@ public:
 	// See if the wildcard pattern matches a string.
 	bool matches(const String &str) const;
 
+	// See if the wildcard pattern matches all paths inside the directory 'dir' (which ends with a
+	// separator). This is the case if the pattern ends with a '*' that may consume everything after
+	// 'dir'.
+	bool matchesAllIn(const String &dir) const;
+
 	// Output
 	friend ostream &operator <<(ostream &to, const Wildcard &from);
 
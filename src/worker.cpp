@@ -0,0 +1,801 @@
+#include "std.h"
+#include "worker.h"
+#include "process.h"
+#include "env.h"
+#include "thread.h"
+
+/**
+ * Message types.
+ */
+enum Message {
+	// Client to worker.
+	mAuth = 'A', // The shared secret. Must be the first message if the worker has a secret.
+	mHello = 'H', // Ask for the number of slots. Answered by 'mSlots'.
+	mRoot = 'R', // Project root.
+	mCwd = 'W', // Working directory.
+	mCommand = 'C', // Command line.
+	mEnv = 'E', // One environment variable, 'name=value'.
+	mInput = 'I', // One input file: relative path, a null character, and the contents.
+	mOutput = 'O', // Relative path of an output file.
+	mRun = 'G', // Run the command.
+
+	// Worker to client.
+	mSlots = 'S', // Number of slots.
+	mStdout = '1', // Output to stdout.
+	mStderr = '2', // Output to stderr.
+	mFile = 'F', // Output file: relative path, a null character, and the contents.
+	mExit = 'Q', // Exit code. Last message.
+};
+
+// Read an entire file.
+static bool readFile(const Path &file, String &out) {
+	ifstream src(toS(file).c_str(), std::ios::binary);
+	if (!src)
+		return false;
+
+	std::ostringstream data;
+	data << src.rdbuf();
+	out = data.str();
+	return true;
+}
+
+// Write an entire file, creating the directory if needed.
+static bool writeFile(const Path &file, const String &data) {
+	file.parent().createDir();
+	ofstream dst(toS(file).c_str(), std::ios::binary);
+	dst.write(data.c_str(), data.size());
+	return bool(dst);
+}
+
+// Split 'data' at the first null character.
+static void splitFile(const String &data, String &path, String &contents) {
+	size_t pos = data.find('\0');
+	if (pos == String::npos) {
+		path = data;
+		contents = "";
+	} else {
+		path = data.substr(0, pos);
+		contents = data.substr(pos + 1);
+	}
+}
+
+// Path as a string, without any trailing separator.
+static String dirStr(const Path &path) {
+	String r = toS(path);
+	if (r.size() > 1 && (r[r.size() - 1] == '/' || r[r.size() - 1] == '\\'))
+		r.erase(r.size() - 1);
+	return r;
+}
+
+// Can 'c' be a part of a file name in a command line?
+static bool pathChar(char c) {
+	if (isalnum((unsigned char)c))
+		return true;
+
+	switch (c) {
+	case '_':
+	case '-':
+	case '.':
+	case '+':
+	case '~':
+	case '/':
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Is the occurrence of a directory at 'pos' in 'str' (of length 'len') a path that starts with the
+// directory? It must be followed by a separator or by the end of the token, and must not be a part
+// of another path. Options like -I<dir> and -iquote<dir> are allowed in front of it.
+static bool pathAt(const String &str, size_t pos, size_t len) {
+	size_t end = pos + len;
+	if (end < str.size() && str[end] != '/' && pathChar(str[end]))
+		return false;
+
+	if (pos == 0 || !pathChar(str[pos - 1]))
+		return true;
+
+	size_t start = pos;
+	while (start > 0 && isalpha((unsigned char)str[start - 1]))
+		start--;
+
+	return start < pos
+		&& start > 0
+		&& str[start - 1] == '-'
+		&& (start == 1 || !pathChar(str[start - 2]));
+}
+
+// Replace all paths in 'str' that start with the directory 'from' so that they start with 'to'
+// instead. Neither 'from' nor 'to' have a trailing separator.
+static String replaceDir(const String &str, const String &from, const String &to) {
+	if (from.empty())
+		return str;
+
+	String result;
+	size_t last = 0;
+	size_t pos = str.find(from);
+	while (pos != String::npos) {
+		if (pathAt(str, pos, from.size())) {
+			result.append(str, last, pos - last);
+			result += to;
+			last = pos + from.size();
+			pos = str.find(from, last);
+		} else {
+			pos = str.find(from, pos + 1);
+		}
+	}
+	result.append(str, last, String::npos);
+	return result;
+}
+
+// Is 'path' a relative path that stays inside the directory it is relative to?
+static bool safePath(const String &path) {
+	if (path.empty() || path[0] == '/')
+		return false;
+
+	size_t start = 0;
+	while (start <= path.size()) {
+		size_t end = path.find('/', start);
+		if (end == String::npos)
+			end = path.size();
+		if (path.compare(start, end - start, "..") == 0)
+			return false;
+		start = end + 1;
+	}
+	return true;
+}
+
+// File containing the shared secret, if any.
+static Path secretFile;
+
+void setWorkerSecret(const Path &file) {
+	secretFile = file;
+}
+
+// Our own executable.
+static Path selfPath();
+
+void submitCommand(const RemoteJob &job, const String &address, Path &file, vector<String> &args) {
+	file = selfPath();
+
+	args.clear();
+	args << String("--submit") << address << dirStr(job.root) << toS(job.cwd) << job.command;
+	if (!secretFile.isEmpty())
+		args << String("-s") << toS(secretFile);
+	for (nat i = 0; i < job.inputs.size(); i++)
+		args << String("-i") << toS(job.inputs[i]);
+	for (nat i = 0; i < job.outputs.size(); i++)
+		args << String("-o") << toS(job.outputs[i]);
+}
+
+#ifdef WINDOWS
+
+static Path selfPath() {
+	char buf[MAX_PATH + 1] = { 0 };
+	GetModuleFileName(NULL, buf, MAX_PATH);
+	return Path(buf);
+}
+
+int runWorker(const String &, nat) {
+	PLN("Build workers are not supported on Windows.");
+	return 1;
+}
+
+bool queryWorker(const String &address, nat &) {
+	WARNING("Build workers are not supported on Windows. Ignoring " << address << ".");
+	return false;
+}
+
+int submitMain(const vector<String> &) {
+	PLN("Build workers are not supported on Windows.");
+	return 1;
+}
+
+#else
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+extern char **environ;
+
+static Path selfPath() {
+	char buf[4096];
+	ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return Path("mm");
+	return Path(String(buf, len));
+}
+
+// Load the shared secret from 'secretFile', if any. Returns false if it could not be read.
+static bool loadSecret(String &secret) {
+	secret = "";
+	if (secretFile.isEmpty())
+		return true;
+
+	if (!readFile(secretFile, secret))
+		return false;
+
+	while (!secret.empty() && isspace((unsigned char)secret[secret.size() - 1]))
+		secret.erase(secret.size() - 1);
+	return !secret.empty();
+}
+
+// Compare secrets in a way that does not reveal how much of them matched.
+static bool sameSecret(const String &a, const String &b) {
+	if (a.size() != b.size())
+		return false;
+
+	unsigned char diff = 0;
+	for (nat i = 0; i < a.size(); i++)
+		diff |= (unsigned char)(a[i] ^ b[i]);
+	return diff == 0;
+}
+
+/**
+ * A connected socket.
+ */
+class Socket : NoCopy {
+public:
+	// Take ownership of 'fd'.
+	explicit Socket(int fd) : fd(fd), limit(untrustedLimit) {}
+
+	// Close.
+	~Socket() {
+		if (fd >= 0)
+			close(fd);
+	}
+
+	// Send a message.
+	bool send(char type, const String &data) {
+		nat size = nat(data.size());
+		char header[5] = {
+			type,
+			char(size >> 24), char(size >> 16), char(size >> 8), char(size),
+		};
+		return sendAll(header, sizeof(header)) && sendAll(data.c_str(), data.size());
+	}
+
+	inline bool send(char type) {
+		return send(type, String());
+	}
+
+	// Allow receiving large messages. Called when the peer is authenticated.
+	inline void trust() {
+		limit = trustedLimit;
+	}
+
+	// Receive a message. Fails if the message is larger than allowed, so that the connection is
+	// dropped.
+	bool receive(char &type, String &data) {
+		unsigned char header[5];
+		if (!receiveAll(header, sizeof(header)))
+			return false;
+
+		type = char(header[0]);
+		nat size = (nat(header[1]) << 24) | (nat(header[2]) << 16) | (nat(header[3]) << 8) | nat(header[4]);
+		if (size > limit)
+			return false;
+		data.resize(size);
+		return size == 0 || receiveAll(&data[0], size);
+	}
+
+private:
+	// The socket.
+	int fd;
+
+	// Largest message we accept at the moment.
+	nat limit;
+
+	// Limits before and after the peer is authenticated. The secret is the largest message we
+	// expect before that.
+	enum {
+		untrustedLimit = 4 * 1024,
+		trustedLimit = 256 * 1024 * 1024,
+	};
+
+	bool sendAll(const char *data, size_t size) {
+		while (size > 0) {
+			ssize_t r = ::send(fd, data, size, MSG_NOSIGNAL);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				return false;
+			data += r;
+			size -= r;
+		}
+		return true;
+	}
+
+	bool receiveAll(void *to, size_t size) {
+		char *data = (char *)to;
+		while (size > 0) {
+			ssize_t r = recv(fd, data, size, 0);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				return false;
+			data += r;
+			size -= r;
+		}
+		return true;
+	}
+};
+
+// Create a socket for 'address', either bound and listening, or connected to it. Returns -1 on
+// failure, and sets 'error'.
+static int openSocket(const String &address, bool listen, String &error) {
+	if (address.compare(0, 5, "unix:") == 0) {
+		String path = address.substr(5);
+
+		sockaddr_un addr;
+		zeroMem(addr);
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) {
+			error = "path too long";
+			return -1;
+		}
+		memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			error = strerror(errno);
+			return -1;
+		}
+
+		int r;
+		if (listen) {
+			// Remove any stale socket from an earlier worker. Only we may connect to the new one.
+			unlink(path.c_str());
+			mode_t mask = umask(0077);
+			r = bind(fd, (sockaddr *)&addr, sizeof(addr));
+			umask(mask);
+			if (r == 0)
+				r = ::listen(fd, 64);
+		} else {
+			r = connect(fd, (sockaddr *)&addr, sizeof(addr));
+		}
+
+		if (r) {
+			error = strerror(errno);
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	size_t colon = address.rfind(':');
+	if (colon == String::npos) {
+		error = "expected 'unix:<path>' or '<host>:<port>'";
+		return -1;
+	}
+
+	String host = address.substr(0, colon);
+	String port = address.substr(colon + 1);
+
+	// Only listen on the loopback interface unless told otherwise. Listening on all interfaces
+	// requires an explicit address, such as 0.0.0.0.
+	if (host.empty())
+		host = "127.0.0.1";
+
+	addrinfo hints;
+	zeroMem(hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo *found = null;
+	int r = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+	if (r) {
+		error = gai_strerror(r);
+		return -1;
+	}
+
+	int fd = -1;
+	error = "no usable address";
+	for (addrinfo *at = found; at; at = at->ai_next) {
+		fd = socket(at->ai_family, at->ai_socktype | SOCK_CLOEXEC, at->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (listen) {
+			int yes = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+			r = bind(fd, at->ai_addr, at->ai_addrlen);
+			if (r == 0)
+				r = ::listen(fd, 64);
+		} else {
+			r = connect(fd, at->ai_addr, at->ai_addrlen);
+		}
+
+		if (r == 0)
+			break;
+
+		error = strerror(errno);
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(found);
+	return fd;
+}
+
+/**
+ * Worker side.
+ */
+
+/**
+ * State of a worker.
+ */
+class Worker : NoCopy {
+public:
+	Worker(nat slots, const String &secret) : slots(slots), secret(secret), free(slots) {}
+
+	// Number of slots.
+	nat slots;
+
+	// Shared secret. If not empty, clients must send it before anything else.
+	String secret;
+
+	// Free slots.
+	Sema free;
+};
+
+/**
+ * A connection to a worker.
+ */
+class Connection : NoCopy {
+public:
+	Connection(Worker &worker, int fd) : worker(worker), socket(fd) {}
+
+	// Owning worker.
+	Worker &worker;
+
+	// Socket.
+	Socket socket;
+};
+
+// Create a temporary directory.
+static Path tempDir() {
+	const char *tmp = getenv("TMPDIR");
+	String pattern = tmp ? tmp : "/tmp";
+	pattern += "/mymake-worker.XXXXXX";
+
+	vector<char> buffer(pattern.begin(), pattern.end());
+	buffer.push_back(0);
+	if (!mkdtemp(&buffer[0]))
+		return Path();
+
+	Path r(&buffer[0]);
+	r.makeDir();
+	return r;
+}
+
+// Serve one connection. Deletes the connection when done.
+static void serve(Connection &c) {
+	Socket &socket = c.socket;
+
+	String root, cwd, command;
+	Env env = Env::empty();
+	vector<pair<String, String>> inputs;
+	vector<String> outputs;
+
+	char type;
+	String data;
+	if (!c.worker.secret.empty()) {
+		if (!socket.receive(type, data) || type != mAuth || !sameSecret(data, c.worker.secret)) {
+			PLN("Rejected a connection without the correct secret.");
+			delete &c;
+			return;
+		}
+	}
+	socket.trust();
+
+	bool run = false;
+	while (!run && socket.receive(type, data)) {
+		switch (type) {
+		case mHello:
+			socket.send(mSlots, toS(c.worker.slots));
+			break;
+		case mRoot:
+			root = data;
+			break;
+		case mCwd:
+			cwd = data;
+			break;
+		case mCommand:
+			command = data;
+			break;
+		case mEnv: {
+			size_t eq = data.find('=');
+			if (eq != String::npos)
+				env.set(data.substr(0, eq), data.substr(eq + 1));
+			break;
+		}
+		case mInput: {
+			String path, contents;
+			splitFile(data, path, contents);
+			inputs.push_back(make_pair(path, contents));
+			break;
+		}
+		case mOutput:
+			outputs << data;
+			break;
+		case mRun:
+			run = true;
+			break;
+		}
+	}
+
+	if (!run) {
+		delete &c;
+		return;
+	}
+
+	// Only accept paths inside the project root, so that the command can not read or write files
+	// outside the sandbox through them. The client then runs the command locally instead.
+	bool valid = root.size() > 1 && root[0] == '/' && (cwd == root || cwd.compare(0, root.size() + 1, root + "/") == 0);
+	for (nat i = 0; valid && i < inputs.size(); i++)
+		valid = safePath(inputs[i].first);
+	for (nat i = 0; valid && i < outputs.size(); i++)
+		valid = safePath(outputs[i]);
+
+	if (!valid) {
+		PLN("Rejected a command with paths outside of the project root.");
+		delete &c;
+		return;
+	}
+
+	c.worker.free.down();
+
+	Path sandbox = tempDir();
+	Path sandboxRoot = sandbox + "root";
+	sandboxRoot.makeDir();
+	String rootStr = dirStr(sandboxRoot);
+
+	for (nat i = 0; i < inputs.size(); i++)
+		writeFile(sandboxRoot + Path(inputs[i].first), inputs[i].second);
+	for (nat i = 0; i < outputs.size(); i++)
+		(sandboxRoot + Path(outputs[i])).parent().createDir();
+
+	Path wd(rootStr + cwd.substr(root.size()));
+	wd.makeDir();
+	wd.createDir();
+
+	Path outFile = sandbox + "stdout";
+	Path errFile = sandbox + "stderr";
+	String redirect = "exec >'" + toS(outFile) + "' 2>'" + toS(errFile) + "'\n";
+
+	DEBUG("Running " << command << " in " << cwd, INFO);
+
+	int result = 1;
+	Process *p = shellProcess(redirect + replaceDir(command, root, rootStr), wd, &env, 0);
+	if (p->spawn())
+		result = p->wait();
+	delete p;
+
+	c.worker.free.up();
+
+	String out;
+	if (readFile(outFile, out) && !out.empty())
+		socket.send(mStdout, replaceDir(out, rootStr, root));
+	if (readFile(errFile, out) && !out.empty())
+		socket.send(mStderr, replaceDir(out, rootStr, root));
+
+	for (nat i = 0; i < outputs.size(); i++) {
+		String contents;
+		if (readFile(sandboxRoot + Path(outputs[i]), contents))
+			socket.send(mFile, outputs[i] + '\0' + contents);
+	}
+
+	socket.send(mExit, toS(result));
+
+	sandbox.recursiveDelete();
+	delete &c;
+}
+
+int runWorker(const String &address, nat slots) {
+	if (slots < 1)
+		slots = 1;
+
+	String secret;
+	if (!loadSecret(secret)) {
+		PLN("Failed to read the secret from " << secretFile << ".");
+		return 1;
+	}
+
+	// Anyone who can connect to the worker can run commands on it.
+	if (secret.empty() && address.compare(0, 5, "unix:") != 0) {
+		PLN("Workers listening on TCP require a shared secret. Set 'workerSecret' to a file containing it.");
+		return 1;
+	}
+
+	String error;
+	int listener = openSocket(address, true, error);
+	if (listener < 0) {
+		PLN("Failed to listen on " << address << ": " << error);
+		return 1;
+	}
+
+	PLN("Worker listening on " << address << " with " << slots << " slots.");
+
+	Worker worker(slots, secret);
+	while (true) {
+		int fd = accept4(listener, null, null, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			PLN("Failed to accept connections: " << strerror(errno));
+			close(listener);
+			return 1;
+		}
+
+		Connection *c = new Connection(worker, fd);
+		Thread t;
+		t.start(&serve, *c);
+	}
+}
+
+/**
+ * Client side.
+ */
+
+// Send the shared secret, if any. The worker is one we were told to use, so we accept large
+// messages from it afterwards.
+static bool authenticate(Socket &socket, const String &address) {
+	String secret;
+	if (!loadSecret(secret)) {
+		WARNING("Failed to read the secret for the worker " << address << " from " << secretFile << ".");
+		return false;
+	}
+
+	socket.trust();
+	return secret.empty() || socket.send(mAuth, secret);
+}
+
+bool queryWorker(const String &address, nat &slots) {
+	String error;
+	int fd = openSocket(address, false, error);
+	if (fd < 0) {
+		WARNING("Failed to connect to the worker " << address << ": " << error);
+		return false;
+	}
+
+	Socket socket(fd);
+	if (!authenticate(socket, address))
+		return false;
+
+	char type;
+	String data;
+	if (!socket.send(mHello) || !socket.receive(type, data) || type != mSlots) {
+		WARNING("The worker " << address << " did not respond.");
+		return false;
+	}
+
+	slots = to<nat>(data);
+	return slots > 0;
+}
+
+// Run the job on the worker. Returns false if the worker could not be used, in which case nothing
+// has been written to stdout, stderr or the output files. Everything is buffered until the exit
+// code arrives to make sure of that.
+static bool submit(const String &address, const RemoteJob &job, int &result) {
+	String error;
+	int fd = openSocket(address, false, error);
+	if (fd < 0) {
+		WARNING("Failed to connect to the worker " << address << ": " << error);
+		return false;
+	}
+
+	Socket socket(fd);
+	if (!authenticate(socket, address))
+		return false;
+
+	bool ok = socket.send(mRoot, dirStr(job.root))
+		&& socket.send(mCwd, toS(job.cwd))
+		&& socket.send(mCommand, job.command);
+
+	for (char **var = environ; ok && *var; var++)
+		ok = socket.send(mEnv, *var);
+
+	for (nat i = 0; ok && i < job.inputs.size(); i++) {
+		String contents;
+		if (!job.inputs[i].isChild(job.root) || !readFile(job.inputs[i], contents))
+			continue;
+		ok = socket.send(mInput, toS(job.inputs[i].makeRelative(job.root)) + '\0' + contents);
+	}
+
+	vector<String> outputs;
+	for (nat i = 0; i < job.outputs.size(); i++)
+		outputs << toS(job.outputs[i].makeRelative(job.root));
+
+	for (nat i = 0; ok && i < outputs.size(); i++)
+		ok = socket.send(mOutput, outputs[i]);
+
+	if (!ok || !socket.send(mRun)) {
+		WARNING("Failed to send the command to the worker " << address << ".");
+		return false;
+	}
+
+	String out, err;
+	vector<pair<String, String>> files;
+
+	char type;
+	String data;
+	while (socket.receive(type, data)) {
+		switch (type) {
+		case mStdout:
+			out += data;
+			break;
+		case mStderr:
+			err += data;
+			break;
+		case mFile: {
+			String path, contents;
+			splitFile(data, path, contents);
+
+			// Only write the files we asked for.
+			if (std::find(outputs.begin(), outputs.end(), path) == outputs.end()) {
+				WARNING("Ignoring the unexpected file " << path << " from the worker " << address << ".");
+				break;
+			}
+			files.push_back(make_pair(path, contents));
+			break;
+		}
+		case mExit:
+			for (nat i = 0; i < files.size(); i++)
+				writeFile(Path(files[i].first).makeAbsolute(job.root), files[i].second);
+			std::cout << out << std::flush;
+			std::cerr << err << std::flush;
+
+			result = to<int>(data, 1);
+			// Behave like a shell if the command was killed by a signal.
+			if (result < 0)
+				result = 128 - result;
+			return true;
+		}
+	}
+
+	// Nothing has been forwarded yet, so it is fine to run the command locally.
+	WARNING("Lost the connection to the worker " << address << ".");
+	return false;
+}
+
+int submitMain(const vector<String> &args) {
+	if (args.size() < 4) {
+		PLN("Usage: --submit <address> <root> <cwd> <command> [-s <secret file>] [-i <input>] [-o <output>]");
+		return 1;
+	}
+
+	String address = args[0];
+
+	RemoteJob job;
+	job.root = Path(args[1]);
+	job.root.makeDir();
+	job.cwd = Path(args[2]);
+	job.cwd.makeDir();
+	job.command = args[3];
+
+	for (nat i = 4; i + 1 < args.size(); i += 2) {
+		Path file = Path(args[i + 1]).makeAbsolute(job.cwd);
+		if (args[i] == "-s")
+			setWorkerSecret(file);
+		else if (args[i] == "-i")
+			job.inputs << file;
+		else if (args[i] == "-o")
+			job.outputs << file;
+	}
+
+	int result = 1;
+	if (submit(address, job, result))
+		return result;
+
+	DEBUG("Running " << job.command << " locally instead.", INFO);
+	return shellExec(job.command, job.cwd, null, 0);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+#include "path.h"
+
+/**
+ * Build workers.
+ *
+ * A worker is started by 'mm --worker <address>' and accepts commands from other instances of
+ * mymake, either through a Unix socket (the address 'unix:<path>') or through TCP (the address
+ * '<host>:<port>'). For each command, the client sends the command line, the working directory, the
+ * environment variables and all files inside the project root that the command reads (i.e. the
+ * source file and its include closure as found by 'Includes'). The worker recreates the files in a
+ * temporary directory, replaces the project root with that directory in the command, runs it, and
+ * sends back the output files and everything the command wrote to stdout and stderr. Files outside
+ * the project root (e.g. the compiler and system headers) are assumed to be present on the worker
+ * as well.
+ *
+ * The client side is another instance of mymake, started by ProcGroup as 'mm --submit ...' in place
+ * of the original command. It behaves like the original command: it writes the output of the
+ * remote command to stdout and stderr, and exits with the same exit code. This means that remote
+ * commands are handled just like local ones by the rest of the system. If the worker can not be
+ * reached, the command is executed locally instead.
+ *
+ * Anyone who can connect to a worker can run commands on it. A worker therefore listens on the
+ * loopback interface unless a host is given explicitly, Unix sockets are only accessible to the
+ * current user, and a worker that listens on TCP requires a shared secret (read from the file in
+ * 'workerSecret'). The worker only accepts input and output files inside the project root, and the
+ * client only accepts the output files it asked for.
+ *
+ * The protocol consists of messages with a one byte type, a four byte length (big endian), and
+ * the contents.
+ */
+
+/**
+ * A command that may be executed on a worker.
+ */
+class RemoteJob {
+public:
+	// Root of the project. Files inside it are sent to the worker.
+	Path root;
+
+	// Command line, executed through a shell.
+	String command;
+
+	// Working directory.
+	Path cwd;
+
+	// Files read by the command.
+	vector<Path> inputs;
+
+	// Files produced by the command.
+	vector<Path> outputs;
+};
+
+// Use the shared secret in 'file' when connecting to workers, or require it from clients when
+// running as a worker. An empty path means no secret.
+void setWorkerSecret(const Path &file);
+
+// Run a worker, accepting commands on 'address'. Runs at most 'slots' commands concurrently.
+int runWorker(const String &address, nat slots);
+
+// Ask the worker at 'address' how many commands it can run concurrently. Returns false if the worker
+// could not be reached.
+bool queryWorker(const String &address, nat &slots);
+
+// Create the command line for submitting 'job' to the worker at 'address'.
+void submitCommand(const RemoteJob &job, const String &address, Path &file, vector<String> &args);
+
+// Entry point for 'mm --submit'. 'args' are the arguments after '--submit'.
+int submitMain(const vector<String> &args);
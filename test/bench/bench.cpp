@@ -0,0 +1,482 @@
+#include "std.h"
+#include "path.h"
+#include "hash.h"
+#include "oldpath.h"
+#include <set>
+#include <iomanip>
+
+/**
+ * Microbenchmarks and differential tests for the data structures in the hot paths of mymake.
+ *
+ * bench path     - compare Path to the previous implementation (OldPath).
+ * bench hash     - compare FlatMap to std::unordered_map with paths as keys.
+ * bench check    - check that Path behaves like OldPath, and that FlatMap behaves like
+ *                  std::unordered_map. Exits with a non-zero code if they differ.
+ * bench project <dir> [sources] [headers]
+ *                - generate a synthetic target with many sources that share many headers, for
+ *                  measuring the time mymake spends finding dependencies. Build it with 'mm -t'
+ *                  using the versions of mymake to compare.
+ *
+ * Without parameters, runs 'check', 'path' and 'hash'. Build with 'mm release' to get meaningful
+ * numbers.
+ */
+
+// Deterministic random numbers, so that all runs use the same data.
+static nat64 randState = 1;
+static nat random(nat max) {
+	randState ^= randState << 13;
+	randState ^= randState >> 7;
+	randState ^= randState << 17;
+	return nat(randState % max);
+}
+
+// Names used in generated paths.
+static const char *names[] = {
+	"src", "include", "lib", "core", "util", "test", "build", "detail", "impl", "io",
+	"net", "gui", "platform", "common", "parser", "compiler", "runtime", "storage",
+};
+
+static const char *exts[] = { "cpp", "h", "hpp", "c", "o" };
+
+// Generate a path with 'depth' parts.
+static String randomPath(nat depth) {
+	std::ostringstream out;
+	out << "/home/user";
+	for (nat i = 2; i + 1 < depth; i++)
+		out << '/' << names[random(ARRAY_COUNT(names))];
+	out << '/' << names[random(ARRAY_COUNT(names))] << random(100) << '.' << exts[random(ARRAY_COUNT(exts))];
+	return out.str();
+}
+
+// Generate 'count' paths with a depth of 6 to 10 parts.
+static vector<String> randomPaths(nat count) {
+	vector<String> result;
+	for (nat i = 0; i < count; i++)
+		result << randomPath(6 + random(5));
+	return result;
+}
+
+// Prevents the compiler from removing computations whose results are not used.
+static volatile size_t sink;
+
+/**
+ * Measures the time of a number of operations.
+ */
+class Measure {
+public:
+	Measure(nat count) : count(count) {}
+
+	// Number of operations.
+	nat count;
+
+	// Time per operation so far, in nanoseconds.
+	int64 ns() const {
+		return (Timestamp() - start).micros() * 1000 / max(count, nat(1));
+	}
+
+private:
+	// Start time.
+	Timestamp start;
+};
+
+/**
+ * Results of one benchmark, in nanoseconds per operation.
+ */
+typedef vector<pair<String, int64>> Results;
+
+// Print the results of the same benchmarks for two implementations.
+static void print(const Results &a, const String &aName, const Results &b, const String &bName) {
+	PLN("  " << std::setw(18) << std::left << "ns/op" << std::setw(10) << std::right << aName << std::setw(10) << bName);
+	for (nat i = 0; i < a.size(); i++)
+		PLN("  " << std::setw(18) << std::left << a[i].first << std::setw(10) << std::right << a[i].second << std::setw(10) << b[i].second);
+}
+
+template <class P>
+static Results benchPath(const vector<String> &strs) {
+	Results r;
+	nat n = strs.size();
+	size_t sum = 0;
+
+	vector<P> paths;
+	paths.reserve(n);
+	{
+		Measure m(n);
+		for (nat i = 0; i < n; i++)
+			paths.push_back(P(strs[i]));
+		r << make_pair(String("parse"), m.ns());
+	}
+
+	{
+		Measure m(n);
+		for (nat i = 0; i < n; i++) {
+			P p = paths[i].parent() + paths[(i * 7) % n].title();
+			sum += p.isDir();
+		}
+		r << make_pair(String("parent + join"), m.ns());
+	}
+
+	{
+		Measure m(n);
+		for (nat i = 0; i < n; i++) {
+			P p = paths[i].makeRelative(paths[(i * 7) % n].parent());
+			sum += p.isDir();
+		}
+		r << make_pair(String("makeRelative"), m.ns());
+	}
+
+	{
+		nat rounds = 10;
+		Measure m(n * rounds);
+		for (nat j = 0; j < rounds; j++)
+			for (nat i = 0; i < n; i++)
+				sum += paths[i].hash();
+		r << make_pair(String("hash"), m.ns());
+	}
+
+	{
+		Measure m(n);
+		for (nat i = 0; i < n; i++)
+			sum += toS(paths[i]).size();
+		r << make_pair(String("toS"), m.ns());
+	}
+
+	{
+		P base = paths[0].parent().parent();
+		Measure m(n);
+		for (nat i = 0; i < n; i++)
+			sum += paths[i].isChild(base) + (paths[i] == paths[(i * 7) % n]);
+		r << make_pair(String("isChild + =="), m.ns());
+	}
+
+	{
+		std::unordered_set<P> set(paths.begin(), paths.end());
+		Measure m(n);
+		for (nat i = 0; i < n; i++)
+			sum += set.count(paths[(i * 7) % n]);
+		r << make_pair(String("hash_set lookup"), m.ns());
+	}
+
+	{
+		std::set<P> set(paths.begin(), paths.end());
+		Measure m(n);
+		for (nat i = 0; i < n; i++)
+			sum += set.count(paths[(i * 7) % n]);
+		r << make_pair(String("set lookup"), m.ns());
+	}
+
+	sink = sum;
+	return r;
+}
+
+static void benchPath() {
+	nat count = 20000;
+	vector<String> strs = randomPaths(count);
+	PLN("Path, " << count << " paths with 6 to 10 parts:");
+
+	// Run the old implementation first, so that it does not benefit from warm caches.
+	Results old = benchPath<OldPath>(strs);
+	Results now = benchPath<Path>(strs);
+	print(old, "old", now, "new");
+}
+
+template <class M>
+static Results benchMap(const vector<Path> &keys, const vector<Path> &lookups) {
+	Results r;
+	size_t sum = 0;
+
+	M map;
+	{
+		Measure m(keys.size());
+		for (nat i = 0; i < keys.size(); i++)
+			map.insert(make_pair(keys[i], i));
+		r << make_pair(String("insert"), m.ns());
+	}
+
+	{
+		Measure m(lookups.size());
+		for (nat i = 0; i < lookups.size(); i++) {
+			typename M::const_iterator f = map.find(lookups[i]);
+			if (f != map.end())
+				sum += f->second;
+		}
+		r << make_pair(String("lookup"), m.ns());
+	}
+
+	{
+		nat rounds = 10;
+		Measure m(map.size() * rounds);
+		for (nat j = 0; j < rounds; j++)
+			for (typename M::const_iterator i = map.begin(); i != map.end(); ++i)
+				sum += i->second;
+		r << make_pair(String("iterate"), m.ns());
+	}
+
+	sink = sum;
+	return r;
+}
+
+static void benchHash() {
+	nat count = 30000;
+	nat lookupCount = 100000;
+	vector<String> strs = randomPaths(count);
+	vector<Path> keys(strs.begin(), strs.end());
+
+	// About 30% of the lookups miss.
+	vector<String> lookupStrs;
+	for (nat i = 0; i < lookupCount; i++) {
+		if (random(10) < 3)
+			lookupStrs << randomPath(6 + random(5)) + ".miss";
+		else
+			lookupStrs << strs[random(count)];
+	}
+	vector<Path> lookups(lookupStrs.begin(), lookupStrs.end());
+
+	PLN("Maps from " << count << " paths, " << lookupCount << " lookups of which 30% miss:");
+	Results old = benchMap<hash_map<Path, nat>>(keys, lookups);
+	Results now = benchMap<FlatMap<Path, nat>>(keys, lookups);
+	print(old, "unordered", now, "FlatMap");
+
+	FlatMap<Path, nat> map;
+	for (nat i = 0; i < keys.size(); i++)
+		map.insert(make_pair(keys[i], i));
+
+	size_t sum = 0;
+	int64 viaPath, direct;
+	{
+		Measure m(lookupCount);
+		for (nat i = 0; i < lookupCount; i++)
+			sum += map.count(Path(lookupStrs[i]));
+		viaPath = m.ns();
+	}
+	{
+		Measure m(lookupCount);
+		for (nat i = 0; i < lookupCount; i++)
+			sum += map.count(lookupStrs[i]);
+		direct = m.ns();
+	}
+	sink = sum;
+	PLN("  Lookup by string: " << viaPath << " ns through Path(str), " << direct << " ns directly.");
+}
+
+// Number of differences found by 'check'.
+static nat differences = 0;
+
+// Report a difference.
+#define DIFF(what) \
+	do { \
+		if (differences++ < 20) \
+			PLN("Difference: " << what); \
+	} while (false)
+
+// Compare the result of an operation on a Path and an OldPath.
+#define SAME(op, a, b) \
+	do { \
+		String x = toS(a); \
+		String y = toS(b); \
+		if (x != y) \
+			DIFF(op << ": " << x << " (new) != " << y << " (old)"); \
+	} while (false)
+
+// Check that Path and OldPath agree on 'a' and 'b'.
+static void checkPair(const String &a, const String &b) {
+	Path na(a), nb(b);
+	OldPath oa(a), ob(b);
+
+	SAME("Path(" << a << ")", na, oa);
+	SAME(a << " == " << b, na == nb, oa == ob);
+	SAME(a << " < " << b, na < nb, oa < ob);
+	SAME(a << " isChild " << b, na.isChild(nb), oa.isChild(ob));
+	SAME(a << " makeRelative " << b, na.makeRelative(nb), oa.makeRelative(ob));
+	if (!nb.isAbsolute())
+		SAME(a << " + " << b, na + nb, oa + ob);
+
+	// Hashes must be consistent with equality.
+	if ((na == nb) && na.hash() != nb.hash())
+		DIFF(a << " and " << b << " are equal but have different hashes");
+}
+
+// Check operations on a single path.
+static void checkOne(const String &a) {
+	Path n(a);
+	OldPath o(a);
+
+	SAME(a << " isAbsolute", n.isAbsolute(), o.isAbsolute());
+	SAME(a << " isDir", n.isDir(), o.isDir());
+	SAME(a << " isEmpty", n.isEmpty(), o.isEmpty());
+	SAME(a << " + name", n + String("name"), o + String("name"));
+	if (n.isEmpty())
+		return;
+
+	SAME(a << " parent", n.parent(), o.parent());
+	SAME(a << " title", n.title(), o.title());
+	SAME(a << " titleNoExt", n.titleNoExt(), o.titleNoExt());
+	SAME(a << " ext", n.ext(), o.ext());
+
+	Path ne = n;
+	OldPath oe = o;
+	ne.makeExt("x");
+	oe.makeExt("x");
+	SAME(a << " makeExt", ne, oe);
+	ne.makeExt("");
+	oe.makeExt("");
+	SAME(a << " makeExt('')", ne, oe);
+
+	Path nd = n;
+	OldPath od = o;
+	nd.makeDir();
+	od.makeDir();
+	SAME(a << " makeDir", nd, od);
+}
+
+static void checkPaths() {
+	const char *edges[] = {
+		"", "/", ".", "./", "..", "../", "../..", "a", "a/", "/a", "/a/", "a/b", "a//b", "a/./b",
+		"a/../b", "../a", "a/b/../../..", "/a/b/c.d.e", "a.b/c", ".hidden", "a/.hidden/b.txt",
+		"x/y/", "/x/y", "/x/y/z.cpp", "/x/yz", "x/y/..", "./a/./", "a/b/c/../../d/",
+	};
+
+	vector<String> strs(edges, edges + ARRAY_COUNT(edges));
+	for (nat i = 0; i < 200; i++) {
+		String s = randomPath(1 + random(6));
+		if (random(3) == 0)
+			s = s.substr(1);
+		if (random(4) == 0)
+			s += "/";
+		if (random(5) == 0)
+			s += "/../" + String(names[random(ARRAY_COUNT(names))]);
+		strs << s;
+	}
+
+	for (nat i = 0; i < strs.size(); i++) {
+		checkOne(strs[i]);
+		for (nat j = 0; j < strs.size(); j++)
+			checkPair(strs[i], strs[j]);
+	}
+}
+
+static void checkMaps() {
+	nat operations = 2000000;
+	vector<String> strs = randomPaths(5000);
+	vector<Path> keys(strs.begin(), strs.end());
+
+	hash_map<Path, nat> ref;
+	FlatMap<Path, nat> map;
+	for (nat i = 0; i < operations; i++) {
+		nat k = random(keys.size());
+		const Path &key = keys[k];
+
+		switch (random(4)) {
+		case 0: {
+			bool a = ref.insert(make_pair(key, i)).second;
+			bool b = map.insert(make_pair(key, i)).second;
+			if (a != b)
+				DIFF("insert " << key);
+			break;
+		}
+		case 1:
+			if (ref.erase(key) != map.erase(key))
+				DIFF("erase " << key);
+			break;
+		case 2: {
+			hash_map<Path, nat>::const_iterator a = ref.find(key);
+			FlatMap<Path, nat>::const_iterator b = map.find(key);
+			if ((a == ref.end()) != (b == map.end()) || (a != ref.end() && a->second != b->second))
+				DIFF("find " << key);
+			break;
+		}
+		case 3:
+			if (ref.count(key) != map.count(strs[k]))
+				DIFF("count by string " << key);
+			break;
+		}
+
+		if (ref.size() != map.size())
+			DIFF("size after " << i << " operations");
+	}
+
+	for (FlatMap<Path, nat>::const_iterator i = map.begin(); i != map.end(); ++i) {
+		hash_map<Path, nat>::const_iterator f = ref.find(i->first);
+		if (f == ref.end() || f->second != i->second)
+			DIFF("contents " << i->first);
+	}
+}
+
+static int check() {
+	differences = 0;
+	checkPaths();
+	checkMaps();
+
+	if (differences) {
+		PLN("Found " << differences << " differences.");
+		return 1;
+	}
+	PLN("Path matches OldPath, and FlatMap matches std::unordered_map.");
+	return 0;
+}
+
+// Generate a synthetic target in 'dir'. Each header includes 6 others, and each source includes 3
+// headers. Compiling only touches the output, so that the time is spent in mymake.
+static int project(const Path &dir, nat sources, nat headers) {
+	dir.createDir();
+
+	{
+		ofstream to(toS(dir + ".mymake").c_str());
+		to << "[]\n";
+		to << "input=*\n";
+		to << "execute=no\n";
+		to << "compile=*:touch <output>\n";
+		to << "link=touch <output>\n";
+	}
+
+	for (nat i = 0; i < headers; i++) {
+		ofstream to(toS(dir + ("h" + toS(i) + ".h")).c_str());
+		to << "#pragma once\n";
+		for (nat j = 0; j < 6; j++)
+			to << "#include \"h" << random(headers) << ".h\"\n";
+	}
+
+	for (nat i = 0; i < sources; i++) {
+		ofstream to(toS(dir + ("s" + toS(i) + ".cpp")).c_str());
+		for (nat j = 0; j < 3; j++)
+			to << "#include \"h" << random(headers) << ".h\"\n";
+		to << "void f" << i << "() {}\n";
+	}
+
+	PLN("Generated " << sources << " sources and " << headers << " headers in " << dir);
+	return 0;
+}
+
+static int run(int argc, const char *argv[]) {
+	String mode = argc > 1 ? argv[1] : "";
+
+	if (mode == "path") {
+		benchPath();
+	} else if (mode == "hash") {
+		benchHash();
+	} else if (mode == "check") {
+		return check();
+	} else if (mode == "project" && argc > 2) {
+		Path dir = Path(String(argv[2])).makeAbsolute();
+		dir.makeDir();
+		nat sources = argc > 3 ? to<nat>(argv[3]) : 1500;
+		nat headers = argc > 4 ? to<nat>(argv[4]) : 800;
+		return project(dir, sources, headers);
+	} else if (mode.empty()) {
+		int r = check();
+		benchPath();
+		benchHash();
+		return r;
+	} else {
+		PLN("Usage: bench [path|hash|check|project <dir> [sources] [headers]]");
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, const char *argv[]) {
+	outputState = new OutputState();
+	int r = run(argc, argv);
+	outputState->unref();
+	return r;
+}
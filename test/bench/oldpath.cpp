@@ -0,0 +1,219 @@
+#include "std.h"
+#include "oldpath.h"
+#include <cstring>
+
+OldPath::OldPath(const String &path) : isDirectory(false) {
+	parseStr(path);
+	simplify();
+}
+
+OldPath::OldPath() : isDirectory(false) {}
+
+void OldPath::parseStr(const String &str) {
+	if (str.empty())
+		return;
+
+	nat numPaths = std::count(str.begin(), str.end(), '\\');
+	numPaths += std::count(str.begin(), str.end(), '/');
+	parts.reserve(numPaths + 1);
+
+	if (str[0] == '\\' || str[0] == '/')
+		parts.push_back("");
+
+	nat startAt = 0;
+	for (nat i = 0; i < str.size(); i++) {
+		if (str[i] == '\\' || str[i] == '/') {
+			if (i > startAt) {
+				parts.push_back(str.substr(startAt, i - startAt));
+			}
+			startAt = i + 1;
+		}
+	}
+
+	if (str.size() > startAt) {
+		parts.push_back(str.substr(startAt));
+		isDirectory = false;
+	} else {
+		isDirectory = true;
+	}
+}
+
+void OldPath::simplify() {
+	vector<String>::iterator i = parts.begin();
+	while (i != parts.end()) {
+		if (*i == ".") {
+			// Safely removed.
+			i = parts.erase(i);
+		} else if (*i == ".." && i != parts.begin() && *(i - 1) != "..") {
+			// Remove previous path.
+			i = parts.erase(--i);
+			i = parts.erase(i);
+		} else {
+			// Nothing to do, continue.
+			++i;
+		}
+	}
+}
+
+std::ostream &operator <<(std::ostream &to, const OldPath &path) {
+	join(to, path.parts, "/");
+	if (path.parts.empty())
+		to << '.';
+	if (path.isDir()) to << "/";
+	return to;
+}
+
+String toS(const OldPath &p) {
+	std::ostringstream out;
+	out << p;
+	return out.str();
+}
+
+bool OldPath::operator ==(const OldPath &o) const {
+	if (isDirectory != o.isDirectory)
+		return false;
+	if (parts.size() != o.parts.size())
+		return false;
+
+	for (nat i = 0; i < parts.size(); i++)
+		if (parts[i] != o.parts[i])
+			return false;
+	return true;
+}
+
+bool OldPath::operator <(const OldPath &o) const {
+	for (nat i = 0; i < parts.size(); i++) {
+		if (o.parts.size() <= i)
+			return false;
+
+		int r = strcmp(parts[i].c_str(), o.parts[i].c_str());
+		if (r != 0)
+			return r < 0;
+	}
+
+	if (parts.size() < o.parts.size())
+		return true;
+
+	if (isDirectory != o.isDirectory)
+		return o.isDirectory;
+
+	return false;
+}
+
+size_t OldPath::hash() const {
+	// djb2-inspired hash
+	size_t r = 5381;
+	for (nat i = 0; i < parts.size(); i++) {
+		const String &part = parts[i];
+		for (nat j = 0; j < part.size(); j++)
+			r = ((r << 5) + r) + part[j];
+		r = ((r << 5) + r) + '/'; // To differentiate between different divisions of slashes.
+	}
+
+	return r;
+}
+
+bool OldPath::isAbsolute() const {
+	if (parts.size() == 0)
+		return false;
+	return parts.front().empty();
+}
+
+OldPath OldPath::operator +(const OldPath &other) const {
+	OldPath result(*this);
+	result += other;
+	return result;
+}
+
+OldPath &OldPath::operator +=(const OldPath &other) {
+	isDirectory = other.isDirectory;
+	parts.insert(parts.end(), other.parts.begin(), other.parts.end());
+	simplify();
+	return *this;
+}
+
+OldPath OldPath::operator +(const String &name) const {
+	OldPath result(*this);
+	result += name;
+	return result;
+}
+
+OldPath &OldPath::operator +=(const String &name) {
+	parts.push_back(name);
+	isDirectory = false;
+	return *this;
+}
+
+OldPath OldPath::parent() const {
+	OldPath result(*this);
+	result.parts.pop_back();
+	result.isDirectory = true;
+	return result;
+}
+
+String OldPath::title() const {
+	return parts.back();
+}
+
+String OldPath::titleNoExt() const {
+	String t = title();
+	nat last = t.rfind('.');
+	return t.substr(0, last);
+}
+
+String OldPath::ext() const {
+	String t = title();
+	nat p = t.rfind('.');
+	if (p == String::npos)
+		return "";
+	else
+		return t.substr(p + 1);
+}
+
+void OldPath::makeExt(const String &str) {
+	if (str.empty()) {
+		parts.back() = titleNoExt();
+	} else {
+		parts.back() = titleNoExt() + "." + str;
+	}
+}
+
+OldPath OldPath::makeRelative(const OldPath &to) const {
+	OldPath result;
+	result.isDirectory = isDirectory;
+
+	bool equal = true;
+	nat consumed = 0;
+
+	for (nat i = 0; i < to.parts.size(); i++) {
+		if (!equal) {
+			result.parts.push_back("..");
+		} else if (i >= parts.size()) {
+			result.parts.push_back("..");
+			equal = false;
+		} else if (to.parts[i] != parts[i]) {
+			result.parts.push_back("..");
+			equal = false;
+		} else {
+			consumed++;
+		}
+	}
+
+	for (nat i = consumed; i < parts.size(); i++) {
+		result.parts.push_back(parts[i]);
+	}
+
+	return result;
+}
+
+bool OldPath::isChild(const OldPath &path) const {
+	if (parts.size() <= path.parts.size())
+		return false;
+
+	for (nat i = 0; i < path.parts.size(); i++) {
+		if (parts[i] != path.parts[i])
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+/**
+ * The previous implementation of Path, which stored one string for each part of the path. Only the
+ * operations that do not touch the file system are kept. Used as a reference: both to compare the
+ * results of Path against, and to compare the performance against.
+ *
+ * Only implements the semantics on Unix-like systems.
+ */
+class OldPath {
+	friend std::ostream &operator <<(std::ostream &to, const OldPath &path);
+public:
+	// Create an empty path.
+	OldPath();
+
+	// Create a path object from a string.
+	explicit OldPath(const String &path);
+
+	// Comparison.
+	bool operator ==(const OldPath &o) const;
+	inline bool operator !=(const OldPath &o) const { return !(*this == o); }
+	bool operator <(const OldPath &o) const;
+
+	// Concat this path with another path, the other path must be relative.
+	OldPath operator +(const OldPath &other) const;
+	OldPath &operator +=(const OldPath &other);
+
+	// Add a string to go deeper into the hierarchy.
+	OldPath operator +(const String &file) const;
+	OldPath &operator +=(const String &file);
+
+	// Status about this path.
+	inline bool isDir() const { return isDirectory; }
+	bool isAbsolute() const;
+	inline bool isEmpty() const { return parts.empty(); }
+
+	// Make this obj a directory.
+	inline void makeDir() { isDirectory = true; }
+
+	// Get parent directory.
+	OldPath parent() const;
+
+	// Get the title of this file or directory.
+	String title() const;
+	String titleNoExt() const;
+
+	// Get file extension (always the last one).
+	String ext() const;
+
+	// Set the file extension (always the last one).
+	void makeExt(const String &ext);
+
+	// Make this path relative to another path.
+	OldPath makeRelative(const OldPath &to) const;
+
+	// Check if this path is a child of another path.
+	bool isChild(const OldPath &to) const;
+
+	// Hash.
+	size_t hash() const;
+
+private:
+	// One string for each part of the pathname.
+	vector<String> parts;
+
+	// Is this a directory?
+	bool isDirectory;
+
+	// Parse a path string.
+	void parseStr(const String &str);
+
+	// Simplify a path string, which means to remove any . and ..
+	void simplify();
+};
+
+// Convert to string.
+String toS(const OldPath &p);
+
+namespace std {
+
+	template <>
+	struct hash<OldPath> {
+		size_t operator ()(const OldPath &p) const {
+			return p.hash();
+		}
+	};
+
+}
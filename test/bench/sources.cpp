@@ -0,0 +1,10 @@
+// Mymake only compiles files inside the target, so the parts of mymake used by the benchmarks are
+// included here.
+#include "../../src/path.cpp"
+#include "../../src/pathtable.cpp"
+#include "../../src/arena.cpp"
+#include "../../src/std.cpp"
+#include "../../src/sync.cpp"
+#include "../../src/output.cpp"
+#include "../../src/timestamp.cpp"
+#include "../../src/timespan.cpp"